@@ -19,100 +19,149 @@
  * Control functions for analog-to-digital converter (ADC).
  * The ADC1 interrupt (22) is used to get signal on end of convertion event.
  * The port D6 (pin 3) is used as analog input (AIN6).
+ * Each start of convertion runs a burst of ADC_BURST_LENGTH convertions
+ * in buffered continuous mode, so only one interrupt is raised per burst.
+ * The analog watchdog trips the relay as soon as a single convertion is
+ * out of the allowed temperature range.
  */
 
 #include "stm8s003/adc.h"
 #include "adc.h"
 #include "params.h"
+#include "relay.h"
+#include "profile.h"
 
-// Filter timeconstant. TIMECONSTANT = log2(1/tc) in
+// Filter timeconstants. TIMECONSTANT = log2(1/tc) in
 //     z' = (1-tc)*z + tc*s  =  z + tc(s-z)
-#define ADC_FILTER_TIMECONSTANT      4
+// The slow one is used while the innovation (s-z) is below the noise
+// level, the timeconstant is then halved for every doubling of the
+// innovation until the fast one is reached.
+#define ADC_FILTER_TC_SLOW           3
+#define ADC_FILTER_TC_FAST           1
+#define ADC_FILTER_NOISE        0x0080 // 2 LSB of 10 bit convertion, ~0.3C
+
+// Number of convertions per burst, the size of ADC data buffer.
+#define ADC_BURST_LENGTH            10
 
 /* The lookup table contains raw ADC and temperature values
- * between 125C and -25C
- * B = 3125, T0=25C, Rntc=10K, Rs=20K
+ * between 125C and -35C, B = 3125, T0=25C, Rntc=10K, Rs=20K.
+ * Nodes are spaced by 16 counts up to RAWTEMP_SPLIT (the steep hot end)
+ * and by 128 counts above it, so the segment is found directly from the
+ * top bits of the ADC value. Node values are shifted by half of the
+ * chord error to minimize the interpolation error (max 0.27C).
  */
-#define RAWTEMP_PWLSEGGROUPS \
-    PWLGROUP(   0,  0,  142,  0, 15, 125.038),\
-    PWLGROUP( 142,  0,  192,  6,  5, 125.038),\
-    PWLGROUP( 334,  6,  320,  5,  6, 83.864),\
-    PWLGROUP( 654, 11,  896,  7,  7, 55.312),\
-    PWLGROUP(1550, 18, 2048,  8,  8, 19.492),\
-    PWLGROUP(3598, 26,  498,  0, 15, -35.580),\
+#define RAWTEMP_TABLE \
+    RAWTEMP( 128,  130.550),	/*  0 */\
+    RAWTEMP( 144,  124.300),	/*  1 */\
+    RAWTEMP( 160,  118.850),	/*  2 */\
+    RAWTEMP( 176,  114.050),	/*  3 */\
+    RAWTEMP( 192,  109.700),	/*  4 */\
+    RAWTEMP( 208,  105.800),	/*  5 */\
+    RAWTEMP( 224,  102.250),	/*  6 */\
+    RAWTEMP( 240,   99.000),	/*  7 */\
+    RAWTEMP( 256,   95.950),	/*  8 */\
+    RAWTEMP( 272,   93.150),	/*  9 */\
+    RAWTEMP( 288,   90.550),	/* 10 */\
+    RAWTEMP( 304,   88.100),	/* 11 */\
+    RAWTEMP( 320,   85.800),	/* 12 */\
+    RAWTEMP( 336,   83.600),	/* 13 */\
+    RAWTEMP( 352,   81.550),	/* 14 */\
+    RAWTEMP( 368,   79.600),	/* 15 */\
+    RAWTEMP( 384,   77.750),	/* 16 */\
+    RAWTEMP( 400,   76.000),	/* 17 */\
+    RAWTEMP( 416,   74.300),	/* 18 */\
+    RAWTEMP( 432,   72.650),	/* 19 */\
+    RAWTEMP( 448,   71.100),	/* 20 */\
+    RAWTEMP( 464,   69.600),	/* 21 */\
+    RAWTEMP( 480,   68.200),	/* 22 */\
+    RAWTEMP( 496,   66.800),	/* 23 */\
+    RAWTEMP( 512,   65.450),	/* 24 */\
+    RAWTEMP( 528,   64.200),	/* 25 */\
+    RAWTEMP( 544,   62.950),	/* 26 */\
+    RAWTEMP( 560,   61.750),	/* 27 */\
+    RAWTEMP( 576,   60.550),	/* 28 */\
+    RAWTEMP( 592,   59.450),	/* 29 */\
+    RAWTEMP( 608,   58.350),	/* 30 */\
+    RAWTEMP( 624,   57.250),	/* 31 */\
+    RAWTEMP( 640,   56.200),	/* 32 */\
+    RAWTEMP( 768,   48.750),	/* 33 */\
+    RAWTEMP( 896,   42.450),	/* 34 */\
+    RAWTEMP(1024,   37.000),	/* 35 */\
+    RAWTEMP(1152,   32.150),	/* 36 */\
+    RAWTEMP(1280,   27.750),	/* 37 */\
+    RAWTEMP(1408,   23.700),	/* 38 */\
+    RAWTEMP(1536,   19.900),	/* 39 */\
+    RAWTEMP(1664,   16.350),	/* 40 */\
+    RAWTEMP(1792,   12.950),	/* 41 */\
+    RAWTEMP(1920,    9.650),	/* 42 */\
+    RAWTEMP(2048,    6.500),	/* 43 */\
+    RAWTEMP(2176,    3.400),	/* 44 */\
+    RAWTEMP(2304,    0.350),	/* 45 */\
+    RAWTEMP(2432,   -2.700),	/* 46 */\
+    RAWTEMP(2560,   -5.700),	/* 47 */\
+    RAWTEMP(2688,   -8.800),	/* 48 */\
+    RAWTEMP(2816,  -11.900),	/* 49 */\
+    RAWTEMP(2944,  -15.150),	/* 50 */\
+    RAWTEMP(3072,  -18.500),	/* 51 */\
+    RAWTEMP(3200,  -22.100),	/* 52 */\
+    RAWTEMP(3328,  -25.900),	/* 53 */\
+    RAWTEMP(3456,  -30.150),	/* 54 */\
+    RAWTEMP(3584,  -34.900),	/* 55 */\
+    RAWTEMP(3712,  -40.600),	/* 56 */\
     /* END */
-#define RAWTEMP_PWLSEGS \
-    PWLSEGM(142, 125.038),	/*   0: 32, (12.7 bits) */\
-    PWLSEGM(174, 114.596),	/*   1: 32, (12.4 bits) */\
-    PWLSEGM(206, 106.263),	/*   2: 32, (12.1 bits) */\
-    PWLSEGM(238, 99.358),	/*   3: 32, (11.9 bits) */\
-    PWLSEGM(270, 93.481),	/*   4: 32, (11.7 bits) */\
-    PWLSEGM(302, 88.374),	/*   5: 32, (11.5 bits) */\
-    PWLSEGM(334, 83.864),	/*   6: 64, (13.3 bits) */\
-    PWLSEGM(398, 76.183),	/*   7: 64, (13.0 bits) */\
-    PWLSEGM(462, 69.797),	/*   8: 64, (12.8 bits) */\
-    PWLSEGM(526, 64.334),	/*   9: 64, (12.6 bits) */\
-    PWLSEGM(590, 59.558),	/*  10: 64, (12.4 bits) */\
-    PWLSEGM(654, 55.312),	/*  11: 128, (14.2 bits) */\
-    PWLSEGM(782, 47.999),	/*  12: 128, (14.0 bits) */\
-    PWLSEGM(910, 41.817),	/*  13: 128, (13.8 bits) */\
-    PWLSEGM(1038, 36.430),	/*  14: 128, (13.6 bits) */\
-    PWLSEGM(1166, 31.628),	/*  15: 128, (13.4 bits) */\
-    PWLSEGM(1294, 27.267),	/*  16: 128, (13.3 bits) */\
-    PWLSEGM(1422, 23.246),	/*  17: 128, (13.2 bits) */\
-    PWLSEGM(1550, 19.492),	/*  18: 256, (15.1 bits) */\
-    PWLSEGM(1806, 12.566),	/*  19: 256, (15.0 bits) */\
-    PWLSEGM(2062, 6.152),	/*  20: 256, (14.9 bits) */\
-    PWLSEGM(2318, 0.009),	/*  21: 256, (14.9 bits) */\
-    PWLSEGM(2574, -6.068),	/*  22: 256, (15.0 bits) */\
-    PWLSEGM(2830, -12.291),	/*  23: 256, (15.1 bits) */\
-    PWLSEGM(3086, -18.927),	/*  24: 256, (15.2 bits) */\
-    PWLSEGM(3342, -26.401),	/*  25: 256, (15.5 bits) */\
-    PWLSEGM(3598, -35.580),	/*  26: END */
 #define RAWTEMP_TABLEBITS     12 // Table optimized for 12 bit input
 #define RAWTEMP_SCALE         20 // 1/2*C (centigrade, rounding *2)
 #define RAWTEMP_COUNT_MAX   3598 // Tmax=-35.580
 #define RAWTEMP_COUNT_MIN    142 // Tmin=125.038
-#define RAWTEMP_T_MAX    125.038
-#define RAWTEMP_T_MIN    -35.580
-
+#define RAWTEMP_FIRST        128 // First node of the table
+#define RAWTEMP_SPLIT        640 // Segment size change
+#define RAWTEMP_LOG2_FINE      4 // 16 counts per segment below RAWTEMP_SPLIT
+#define RAWTEMP_LOG2_COARSE    7 // 128 counts per segment above
+#define RAWTEMP_SPLIT_INDEX  ((RAWTEMP_SPLIT - RAWTEMP_FIRST) >> RAWTEMP_LOG2_FINE)
+#define RAWTEMP_FINE_OFFSET  (RAWTEMP_FIRST >> RAWTEMP_LOG2_FINE)
+#define RAWTEMP_COARSE_OFFSET \
+    ((RAWTEMP_SPLIT >> RAWTEMP_LOG2_COARSE) - RAWTEMP_SPLIT_INDEX)
+#define RAWTEMP_ENTRIES      (sizeof rawtemp / sizeof rawtemp[0])
 
-#define PWLSEGM(adccount,temp) ((int16_t)(RAWTEMP_SCALE*temp))
-#define PWLGROUP(adccount, index, size, entries, logsize, temp) {size, index, logsize}
 
-static const struct {
-    uint16_t size;
-    uint8_t  index;
-    uint8_t  log2_segsize;
-} pwl_seg[] = {
-    RAWTEMP_PWLSEGGROUPS
-};
+#define RAWTEMP(adccount,temp) \
+    ((int16_t)(RAWTEMP_SCALE*(temp) + ((temp) < 0 ? -0.5 : 0.5)))
 
-static const int16_t pwl_interp[] = {
-    RAWTEMP_PWLSEGS
+static const int16_t rawtemp[] = {
+    RAWTEMP_TABLE
 };
 
 static uint16_t filtered;
+static uint16_t history[2];
+static int16_t rawTemperature;
+static int temperature;
 
 
+/**
+ * @brief Conversion of 12 bit ADC value to temperature. The segment index
+ *  is taken from the top bits of the value, so the conversion time doesn't
+ *  depend on the temperature.
+ * @return temperature in tenth of degrees of Celsius.
+ */
 static int16_t getTemp(uint16_t adccount)
 {
-    uint8_t offset;
-    uint8_t i = 0, index;
-    int16_t a, b, temperature;
+    uint8_t index, offset, log2_segsize;
+    int16_t a, temperature;
 
     if (adccount >= RAWTEMP_COUNT_MAX) adccount = RAWTEMP_COUNT_MAX;
+    if (adccount <= RAWTEMP_COUNT_MIN) adccount = RAWTEMP_COUNT_MIN;
 
-    while (adccount >= pwl_seg[i].size) {
-        adccount -= pwl_seg[i].size;
-        i++;
+    if (adccount < RAWTEMP_SPLIT) {
+        log2_segsize = RAWTEMP_LOG2_FINE;
+        index = (uint8_t) (adccount >> RAWTEMP_LOG2_FINE) - RAWTEMP_FINE_OFFSET;
+    } else {
+        log2_segsize = RAWTEMP_LOG2_COARSE;
+        index = (uint8_t) (adccount >> RAWTEMP_LOG2_COARSE) - RAWTEMP_COARSE_OFFSET;
     }
-    index = pwl_seg[i].index + (adccount >> pwl_seg[i].log2_segsize);
-    offset = adccount & ((1 << pwl_seg[i].log2_segsize) - 1);
+    offset = adccount & ((1 << log2_segsize) - 1);
 
-    a = pwl_interp[index];
-    b = pwl_interp[index+1];
-    temperature = a - (((uint16_t)(a - b)*offset) >> pwl_seg[i].log2_segsize);
+    a = rawtemp[index];
+    temperature = a - (((uint16_t) (a - rawtemp[index + 1]) * offset) >> log2_segsize);
 
     // Round:
     temperature = (temperature + 1) >> 1;
@@ -121,24 +170,138 @@ static int16_t getTemp(uint16_t adccount)
 }
 
 
+/**
+ * @brief Inverse of getTemp(), conversion of temperature to 12 bit ADC value
+ *  using the same lookup table. Not for time critical use.
+ * @param temperature in tenth of degrees of Celsius.
+ * @return 12 bit ADC value.
+ */
+static uint16_t getAdcCount(int16_t temperature)
+{
+    uint8_t i, log2_segsize;
+    uint16_t adccount;
+    int16_t a, t = temperature * (RAWTEMP_SCALE / 10);
+
+    if (t > rawtemp[0]) t = rawtemp[0];
+    if (t < rawtemp[RAWTEMP_ENTRIES - 1]) t = rawtemp[RAWTEMP_ENTRIES - 1];
+
+    for (i = 0; i < RAWTEMP_ENTRIES - 2 && rawtemp[i + 1] >= t; i++)
+        ;
+
+    if (i < RAWTEMP_SPLIT_INDEX) {
+        log2_segsize = RAWTEMP_LOG2_FINE;
+        adccount = RAWTEMP_FIRST + ( (uint16_t) i << RAWTEMP_LOG2_FINE);
+    } else {
+        log2_segsize = RAWTEMP_LOG2_COARSE;
+        adccount = RAWTEMP_SPLIT + ( (uint16_t) (i - RAWTEMP_SPLIT_INDEX) << RAWTEMP_LOG2_COARSE);
+    }
+
+    a = rawtemp[i];
+    adccount += ( (uint16_t) (a - t) << log2_segsize) / (uint16_t) (a - rawtemp[i + 1]);
+
+    if (adccount >= RAWTEMP_COUNT_MAX) adccount = RAWTEMP_COUNT_MAX;
+    if (adccount <= RAWTEMP_COUNT_MIN) adccount = RAWTEMP_COUNT_MIN;
+
+    return adccount;
+}
+
+/**
+ * @brief Running median of the last 3 ADC values, used to discard single
+ *  spikes before they get into the filter.
+ * @param adc_v 16 bit ADC value.
+ * @return median of adc_v and the two previous values.
+ */
+static uint16_t medianAdc(uint16_t adc_v)
+{
+    uint16_t a = history[0], b = history[1], m;
+
+    history[0] = b;
+    history[1] = adc_v;
+
+    if (a > b) m = a, a = b, b = m; // a <= b
+
+    if (adc_v <= a) return a;
+    if (adc_v >= b) return b;
+    return adc_v;
+}
+
+/**
+ * @brief Adaptive filter of ADC values. Large steps are tracked with a
+ *  short timeconstant while small changes (noise) are averaged with a long one.
+ * @param adc_v 16 bit ADC value.
+ */
+static void filterAdc(uint16_t adc_v)
+{
+    uint8_t tc = ADC_FILTER_TC_SLOW;
+    bool up = adc_v >= filtered;
+    uint16_t d = up? adc_v - filtered: filtered - adc_v;
+
+    while (tc > ADC_FILTER_TC_FAST && d >= (ADC_FILTER_NOISE << (ADC_FILTER_TC_SLOW - tc)))
+        tc--;
+
+//  Calculate filter:
+//     z' = z + tc(s-z)
+//  Using unsigned integer arith with the sign of innovation kept aside
+//  and restricting timeconstant, TC to power of 2, tc' = log2(1/tc)
+//     z' = z +/- |s-z| >> tc'
+    if (up)
+        filtered += d >> tc;
+    else
+        filtered -= d >> tc;
+}
+
 /**
  * @brief Initialize ADC's configuration registers.
  */
 void initADC()
 {
     ADC_CR1 |= 0x70;    // Prescaler f/18 (SPSEL)
+    ADC_CR3 |= 0x80;    // Data buffer enable (DBUF)
     ADC_CSR |= 0x06;    // select AIN6
     ADC_CSR |= 0x20;    // Interrupt enable (EOCIE)
+    ADC_AWCRH = 0x03;   // Analog watchdog on all 10 buffers (AWEN)
+    ADC_AWCRL = 0xFF;
+    updateAdcWatchdog();
+    ADC_CSR |= 0x10;    // Analog watchdog interrupt enable (AWDIE)
     ADC_CR1 |= 0x01;    // Power up ADC
     filtered = 0;
+    rawTemperature = 0;
+    temperature = 0;
+}
+
+/**
+ * @brief Programs the analog watchdog thresholds from the allowed range
+ *  of temperature. Only the limit on the side where the relay is active is
+ *  used: the maximum for heating and the minimum for cooling. Must be called
+ *  when any of the related parameters is changed.
+ */
+void updateAdcWatchdog()
+{
+    uint16_t low = 0, high = 0x3FF; // 10 bit thresholds
+    int correction = getParamById (PARAM_TEMPERATURE_CORRECTION);
+
+    // The ADC value decreases when the temperature increases.
+    if (getParamById (PARAM_RELAY_MODE) ) {
+        high = getAdcCount (getParamById (PARAM_MIN_TEMPERATURE) - correction)
+               >> (RAWTEMP_TABLEBITS - 10);
+    } else {
+        low = getAdcCount (getParamById (PARAM_MAX_TEMPERATURE) - correction)
+              >> (RAWTEMP_TABLEBITS - 10);
+    }
+
+    ADC_HTRH = high >> 2;
+    ADC_HTRL = high & 0x03;
+    ADC_LTRH = low >> 2;
+    ADC_LTRL = low & 0x03;
 }
 
 /**
- * @brief Sets bit in ADC control register to start data convertion.
+ * @brief Sets bits in ADC control register to start a burst of data
+ *  convertions in continuous mode.
  */
 void startADC()
 {
-    ADC_CR1 |= 0x01;
+    ADC_CR1 |= 0x03;    // Continuous mode (CONT) and start (ADON)
 }
 
 /**
@@ -151,17 +314,22 @@ uint16_t getAdcFiltered()
 }
 
 /**
- * @brief Calculation of real temperature using averaged result of
- *  AnalogToDigital conversion and the lookup table.
+ * @brief Publishes the corrected temperature. Must be called when the
+ *  temperature correction parameter is changed.
+ */
+void updateTemperature()
+{
+    temperature = rawTemperature + getParamById (PARAM_TEMPERATURE_CORRECTION);
+}
+
+/**
+ * @brief Gets the real temperature, as calculated on the last completed
+ *  AnalogToDigital conversion using the averaged result and the lookup table.
  * @return temperature in tenth of degrees of Celsius.
  */
 int getTemperature()
 {
-    // Need 12 bits
-    uint16_t val = getAdcFiltered() >> (16-RAWTEMP_TABLEBITS);
-
-    // Final calculation and correction
-    return getTemp(val) + getParamById (PARAM_TEMPERATURE_CORRECTION);
+    return temperature;
 }
 
 /**
@@ -170,22 +338,54 @@ int getTemperature()
 void ADC1_EOC_handler() __interrupt (22)
 {
     static bool init = false; // init once
-    uint16_t h = ADC_DRH;
-    uint8_t  l = ADC_DRL;
+    uint8_t i;
+    uint16_t v, min = 0xFFFF, max = 0, sum = 0, adc_v;
+
+    PROFILE_ENTER (PROFILE_ADC);
+
+    if (ADC_CSR & 0x40) {
+        // Analog watchdog, the temperature is out of allowed range.
+        tripRelay();
+        ADC_AWSRH = 0;
+        ADC_AWSRL = 0;
+        ADC_CSR &= ~0x40;   // reset AWD
+
+        // The burst is not completed yet
+        if ( (ADC_CSR & 0x80) == 0) {
+            PROFILE_EXIT (PROFILE_ADC);
+            return;
+        }
+    }
+
+    ADC_CR1 &= ~0x02;   // stop continuous mode (CONT)
+
+    // Decimate the burst: drop the lowest and the highest convertion
+    // and sum up remaining 8 of 10 bit results to a 13 bit value.
+    for (i = 0; i < ADC_BURST_LENGTH * 2; i += 2) {
+        v = ( (uint16_t) ADC_DBxR[i] << 2) | ADC_DBxR[i + 1];
+        sum += v;
+
+        if (v < min) min = v;
+        if (v > max) max = v;
+    }
 
     // Create 16 bit result
-    uint16_t adc_v = ((h << 2) | l) << 6;
+    adc_v = (sum - min - max) << 3;
 
     ADC_CSR &= ~0x80;   // reset EOC
+    ADC_CR3 &= ~0x40;   // reset OVR
 
     // init if needed
-    if (!init) filtered = adc_v, init = true;
+    if (!init) {
+        filtered = history[0] = history[1] = adc_v;
+        init = true;
+    }
 
-//  Calculate filter:
-//     z' = (1-tc)*z + tc*s  =  z + tc(s-z)
-//  Using unsigned integer arith
-//     z' = z - tc*z + tc*s
-//  Restricting timeconstant, TC to power of 2, tc' = log2(1/tc)
-//     z' = z - z >> tc' + s >> tc'
-    filtered = filtered - (filtered >> ADC_FILTER_TIMECONSTANT) + (adc_v >> ADC_FILTER_TIMECONSTANT);
+    filterAdc(medianAdc(adc_v));
+
+    // Need 12 bits
+    rawTemperature = getTemp(filtered >> (16-RAWTEMP_TABLEBITS));
+    updateTemperature();
+
+    PROFILE_EXIT (PROFILE_ADC);
 }
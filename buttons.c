@@ -18,13 +18,17 @@
 /**
  * Control functions for buttons.
  * The EXTI2 interrupt (5) is used to get buttons push events.
- * Timer-tick is used to handle anti-bounce, long-press and repeat.
+ * The TIM1 is started by EXTI2 as a one-shot timer, when it expires the
+ * push of a key which is still held is sent to the menu at once.
+ * Timer-tick is used to handle long-press, repeat and release.
  */
 
 #include <stdint.h>
 #include "stm8s003/gpio.h"
+#include "stm8s003/timer.h"
 #include "buttons.h"
 #include "menu.h"
+#include "profile.h"
 
 
 
@@ -33,13 +37,18 @@
 #define ISBUTTON2(n) ((n) & BUTTON2_BIT)
 #define ISBUTTON3(n) ((n) & BUTTON3_BIT)
 
+#define BUTTON_DEBOUNCE_MS   20 // One-shot timer after the first edge
 #define BUTTON_T_ANTI_BOUNCE  2 //  2 * 32ms =  64ms
 #define BUTTON_T_LONGPRESS   64 // 64 * 32ms =   2s
-#define BUTTON_T_REPEAT      34 // 16 * 32ms = 512ms
+#define BUTTON_T_REPEAT      18 // 17..18 * 32ms = 544..576ms before the first repeat
+
+#define BUTTON_ACCEL_REPEATS  6 // Repeats before the step multiplier grows
+#define BUTTON_MAX_MULTIPLIER 16
 
 static uint8_t guard_timer, pending_push;
 static uint8_t settings_repeat_keys, settings_repeat_timeout;
 static uint8_t settings_long_press;
+static uint8_t repeat_count;
 
 
 /**
@@ -54,6 +63,15 @@ void initButtons()
     PC_CR2 |= BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT; // External IRQ enable
 
     EXTI_CR1 |= 0x20;   // generate interrupt on falling edge
+
+    // TIM1 is the one-shot debounce timer with 1ms resolution.
+    TIM1_PSCRH = 0x3E;  // CLK / 16000 = 1KHz
+    TIM1_PSCRL = 0x7F;
+    TIM1_ARRH = 0;
+    TIM1_ARRL = BUTTON_DEBOUNCE_MS;
+    TIM1_CR1 = TIM_CR1_OPM | TIM_CR1_URS;
+    TIM1_EGR = 0x01;    // Load the prescaler, no interrupt due to URS
+    TIM1_IER = TIM_IER_UIE;
 }
 
 /**
@@ -99,19 +117,39 @@ bool getButton3()
  *     Automatically handle:
  *     <press>
  *       call retrigger(t_repeat)
- *       <32 ticks(1sec)>
+ *       <17..18 ticks(0.55sec)>
  *     <press>
  *       call retrigger(t_repeat)
  *       <t_repeat ticks>
  *     <press>
  *       call retrigger(t_repeat)
  *       ...
- * timeout: 1 - 32, for 32ms to 1024ms per repeat
+ * While the key is held, the interval is halved every two repeats down
+ * to a single tick and the step multiplier grows, see getButtonMultiplier().
+ * timeout: 1 - 16, for 32ms to 512ms per repeat
  */
 void buttonRetrigger(uint8_t keys, uint8_t timeout)
 {
     settings_repeat_keys = keys;
-    settings_repeat_timeout = BUTTON_T_REPEAT - timeout;
+    settings_repeat_timeout = timeout;
+}
+
+/**
+ * @brief Gets multiplier of the step for the repeated key press.
+ *  It doubles every four repeats after the first BUTTON_ACCEL_REPEATS.
+ * @return 1 for the first press and repeats, up to BUTTON_MAX_MULTIPLIER.
+ */
+uint8_t getButtonMultiplier()
+{
+    uint8_t n;
+
+    if (repeat_count < BUTTON_ACCEL_REPEATS) {
+        return 1;
+    }
+
+    n = (repeat_count - BUTTON_ACCEL_REPEATS) / 4;
+
+    return (n < 3)? 2 << n: BUTTON_MAX_MULTIPLIER;
 }
 
 
@@ -128,7 +166,7 @@ void buttonEnableLongPress(uint8_t keys)
 
 
 /**
- * @brief Helper to send events to the menu state machine
+ * @brief Helper to queue events for the menu state machine
  */
 static uint8_t handleButtonEvent(uint8_t event_base, uint8_t buttons)
 {
@@ -145,37 +183,31 @@ static uint8_t handleButtonEvent(uint8_t event_base, uint8_t buttons)
         event = event_base + 2;
     }
     if (event) {
-        feedMenu (event);
+        postMenuEvent (event);
     }
     return status;
 }
 
 
 /**
- * @brief Callback for checking button actions
+ * @brief Callback for checking button actions. It is called from the
+ *  timer's interrupt, the resulting events are queued for the menu.
+ *  The first PUSH of a key belongs to TIM1_UPD_handler(), this one only
+ *  handles long-press, repeat and release of the keys:
+ *    LONGPRESS is send after BUTTON_T_LONGPRESS timeout
+ *    PUSH is send when a long_press enabled key is released
+ *    only keys that emitted LONGPRESS event send release event
  */
 void refreshButtons()
 {
     uint8_t event;
     uint8_t status;
     uint8_t pressed, released;
+    uint8_t timeout;
 
     if ( guard_timer == 0 )
         return;
 
-    if ( guard_timer == 1 && (event = pending_push & ~settings_long_press) )  {
-
-        // Filter out PUSH on long_press enabled keys:
-        //   LONGPRESS is send after BUTTON_T_LONGPRESS timeout
-        //   PUSH is send when a long_press enabled key is released
-        //   only keys that emitted LONGPRESS event send release event
-        // Otherwise Send PUSH event to menu
-
-        status = handleButtonEvent(MENU_EVENT_PUSH_BUTTON1, pending_push & ~settings_long_press);
-        pending_push &= ~status;
-        return;
-    }
-
     // Wait at least ANTI_BOUNCE ticks after last button press
     if ( guard_timer < BUTTON_T_ANTI_BOUNCE ) {
         guard_timer++;
@@ -199,7 +231,13 @@ void refreshButtons()
     pressed = ~PC_CR2 & (BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT);
     if ( guard_timer == BUTTON_T_REPEAT && (event = (pressed & settings_repeat_keys)) ) {
 
-        guard_timer = settings_repeat_timeout;
+        if (repeat_count != 255) {
+            repeat_count++;
+        }
+
+        // The interval is halved every two repeats, down to a single tick.
+        timeout = (repeat_count < 16)? settings_repeat_timeout >> (repeat_count / 2): 0;
+        guard_timer = BUTTON_T_REPEAT - (timeout? timeout: 1);
         settings_repeat_keys = 0;
 
         // Send PUSH event to menu for keys where retrigger was requested
@@ -245,9 +283,43 @@ void EXTI2_handler() __interrupt (5)
 {
     uint8_t buttons = ~BUTTONS_PORT & (BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT);
 
+    PROFILE_ENTER (PROFILE_EXTI);
+
     // save new pending button, disable IRQ for active buttons and enable timer
     pending_push |= PC_CR2 & buttons;
     PC_CR2 &= ~buttons;
     guard_timer = 1;
+    repeat_count = 0;
+
+    // (Re)start the one-shot debounce timer.
+    TIM1_CNTRH = 0;
+    TIM1_CNTRL = 0;
+    TIM1_CR1 |= TIM_CR1_CEN;
+
+    PROFILE_EXIT (PROFILE_EXTI);
 }
 
+/**
+ * @brief This function is TIM1 update interrupt request handler. It is
+ *  called once the debounce time after a key press is over. The PUSH of
+ *  the key which is still held is sent at once unless the key is long-press
+ *  enabled. A key which is not held any more was only bouncing, it is
+ *  dropped and its interrupt is enabled again.
+ */
+void TIM1_UPD_handler() __interrupt (11)
+{
+    uint8_t bounced = BUTTONS_PORT & pending_push;
+    uint8_t buttons = ~BUTTONS_PORT & pending_push & ~settings_long_press;
+    uint8_t status;
+
+    TIM1_SR1 &= ~TIM_SR1_UIF;
+
+    pending_push &= ~bounced;
+    PC_CR2 |= bounced;
+
+    // Keys pressed at once are sent one by one.
+    while ( (status = handleButtonEvent (MENU_EVENT_PUSH_BUTTON1, buttons)) ) {
+        pending_push &= ~status;
+        buttons &= ~status;
+    }
+}
@@ -20,9 +20,11 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #include "display.h"
 #include "stm8s003/gpio.h"
+#include "stm8s003/timer.h"
 
 /* Definitions for display */
 // Port A controls segments: B, F
@@ -85,14 +87,56 @@ enum {
 
 // Global variables
 
+#define N_FRAMES    3
+#define NO_FRAME    0xFF
+
+#ifdef CONFIG_USE_DIGIT_MULTIPLEX
+// Each digit of the frame keeps output bytes for segment ports and digit port.
+#define PORT_BF         0
+#define PORT_CG         1
+#define PORT_AEDP       2
+#define PORT_DIGIT_12   3
+#define PORTS_PER_DIGIT 4
+#define FRAME_SIZE      (3 * PORTS_PER_DIGIT)
+#else
+// Each segment of the frame keeps the bits of digits where it is lit.
+#define FRAME_SIZE      8
+#endif
+
+// Length of the multiplex phase, that is the period of timer's interrupt.
+#define DISPLAY_PHASE_US    2000
+
+/**
+ * Display's buffer. The frame being shown is switched by refreshDisplay()
+ * at the beginning of a multiplex cycle to the frame published last time.
+ * A new frame is painted into the frame which is neither shown nor ready,
+ * so neither of them is ever modified while it can be shown.
+ */
+static uint8_t frames[N_FRAMES][FRAME_SIZE];
+static volatile uint8_t frontFrame; // Being shown by refreshDisplay()
+static volatile uint8_t readyFrame; // Published by setDisplayStr()
+static uint8_t backFrame;           // Being painted, NO_FRAME if none
+
 static uint8_t activeSegId;
-static uint8_t display[8];
+#ifdef CONFIG_USE_DIGIT_MULTIPLEX
+static uint8_t activeDigitId;
+#endif
+
+// Time in microseconds the display is lit during the phase, 0 - whole phase.
+static uint16_t blankingDelay;
+
+// Segment masks of the digits as they are painted into display's buffer.
+static uint8_t glyph[3];
+static volatile bool repaint;
 
 static bool displayOff;
 static bool testMode;
 
 /**
- * @brief FontROM. The last element of the table must be '0'.
+ * @brief FontROM. Segment masks are indexed directly by the character code.
+ * To keep the table small only two ranges of characters are mapped:
+ * from '-' to 'T' and from 'c' to 'y'. The second range immediately
+ * follows the first one. Characters without a glyph are blank.
  * The list of segments as they located on display:
  *  _3_       _2_       _1_
  *  <A>       <A>       <A>
@@ -102,42 +146,48 @@ static bool testMode;
  *  <D> (P)   <D> (P)   <D> (P)
  *
  */
-static const uint8_t font[] = {
-    ' ', 0,
-    '-', bit(SEG_G),
-    '0', bit(SEG_B) | bit(SEG_F) | bit(SEG_C) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
-    '1', bit(SEG_B) | bit(SEG_C),
-    '2', bit(SEG_B) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
-    '3', bit(SEG_B) | bit(SEG_C) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D),
-    '4', bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G),
-    '5', bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D),
-    '6', bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
-    '7', bit(SEG_B) | bit(SEG_C) | bit(SEG_A),
-    '8', bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
-    '9', bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D),
-    'A', bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_E),
-    'B', bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E),
-    'C', bit(SEG_F) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
-    'D', bit(SEG_B) | bit(SEG_C) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E),
-    'E', bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
-    'F', bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_E),
-    'H', bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_E),
-    'L', bit(SEG_F) | bit(SEG_D) | bit(SEG_E),
-    'N', bit(SEG_B) | bit(SEG_F) | bit(SEG_C) | bit(SEG_A) | bit(SEG_E),
-    'O', bit(SEG_B) | bit(SEG_F) | bit(SEG_C) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
-    'P', bit(SEG_B) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_E),
-    'R', bit(SEG_A) | bit(SEG_E) | bit(SEG_F),
-    'S', bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D),
-    'T', bit(SEG_F) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E),
-    'c', bit(SEG_G) | bit(SEG_E) | bit(SEG_D),
-    'd', bit(SEG_B) | bit(SEG_C) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E),
-    'h', bit(SEG_F) | bit(SEG_E) | bit(SEG_G) | bit(SEG_C),
-    'o', bit(SEG_G) | bit(SEG_C) | bit(SEG_D) | bit(SEG_E),
-    'n', bit(SEG_C) | bit(SEG_G) | bit(SEG_E),
-    'r', bit(SEG_G) | bit(SEG_E),
-    't', bit(SEG_F) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E),
-    'y', bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_D),
-    0,   0
+#define FONT_UPPER_FIRST    '-'
+#define FONT_UPPER_LAST     'T'
+#define FONT_LOWER_FIRST    'c'
+#define FONT_LOWER_LAST     'y'
+#define FONT_LOWER_OFFSET   (FONT_UPPER_LAST - FONT_UPPER_FIRST + 1)
+#define FONT_INDEX(c)       ( (c) <= FONT_UPPER_LAST? (c) - FONT_UPPER_FIRST: \
+                              (c) - FONT_LOWER_FIRST + FONT_LOWER_OFFSET)
+
+static const uint8_t font[FONT_LOWER_OFFSET + FONT_LOWER_LAST - FONT_LOWER_FIRST + 1] = {
+    [FONT_INDEX ('-')] = bit(SEG_G),
+    [FONT_INDEX ('0')] = bit(SEG_B) | bit(SEG_F) | bit(SEG_C) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('1')] = bit(SEG_B) | bit(SEG_C),
+    [FONT_INDEX ('2')] = bit(SEG_B) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('3')] = bit(SEG_B) | bit(SEG_C) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D),
+    [FONT_INDEX ('4')] = bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G),
+    [FONT_INDEX ('5')] = bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D),
+    [FONT_INDEX ('6')] = bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('7')] = bit(SEG_B) | bit(SEG_C) | bit(SEG_A),
+    [FONT_INDEX ('8')] = bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('9')] = bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D),
+    [FONT_INDEX ('A')] = bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_E),
+    [FONT_INDEX ('B')] = bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('C')] = bit(SEG_F) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('D')] = bit(SEG_B) | bit(SEG_C) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('E')] = bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('F')] = bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_E),
+    [FONT_INDEX ('H')] = bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_E),
+    [FONT_INDEX ('L')] = bit(SEG_F) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('N')] = bit(SEG_B) | bit(SEG_F) | bit(SEG_C) | bit(SEG_A) | bit(SEG_E),
+    [FONT_INDEX ('O')] = bit(SEG_B) | bit(SEG_F) | bit(SEG_C) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('P')] = bit(SEG_B) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_E),
+    [FONT_INDEX ('R')] = bit(SEG_A) | bit(SEG_E) | bit(SEG_F),
+    [FONT_INDEX ('S')] = bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D),
+    [FONT_INDEX ('T')] = bit(SEG_F) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('c')] = bit(SEG_G) | bit(SEG_E) | bit(SEG_D),
+    [FONT_INDEX ('d')] = bit(SEG_B) | bit(SEG_C) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('h')] = bit(SEG_F) | bit(SEG_E) | bit(SEG_G) | bit(SEG_C),
+    [FONT_INDEX ('o')] = bit(SEG_G) | bit(SEG_C) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('n')] = bit(SEG_C) | bit(SEG_G) | bit(SEG_E),
+    [FONT_INDEX ('r')] = bit(SEG_G) | bit(SEG_E),
+    [FONT_INDEX ('t')] = bit(SEG_F) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E),
+    [FONT_INDEX ('y')] = bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_D),
 };
 
 static const uint8_t displaySegment[] = {
@@ -167,9 +217,62 @@ void initDisplay()
     PD_CR1 |= SSD_SEG_A_BIT | SSD_SEG_D_BIT | SSD_SEG_E_BIT | SSD_SEG_P_BIT | SSD_DIGIT_3_BIT;
     displayOff = false;
     activeSegId = 0;
+#ifdef CONFIG_USE_DIGIT_MULTIPLEX
+    activeDigitId = 0;
+#endif
+    frontFrame = 0;
+    readyFrame = 0;
+    backFrame = NO_FRAME;
+    repaint = true;
+
+    // TIM2 is a free-running counter at 1MHz, the same way it is used by
+    // the profiler. Blanking of the display is scheduled with the compare.
+    TIM2_PSCR = 0x04;   // CLK / 16 = 1MHz
+    TIM2_ARRH = 0xFF;
+    TIM2_ARRL = 0xFF;
+    TIM2_CR1 = TIM_CR1_CEN;
+
     setDisplayTestMode (true, "");
 }
 
+/**
+ * @brief Sets brightness of the display. Dimming is done by blanking
+ *  the display for the rest of each multiplex phase.
+ * @param level
+ *  brightness from 1 to DISPLAY_BRIGHTNESS_MAX.
+ */
+void setDisplayBrightness (uint8_t level)
+{
+    if (level >= DISPLAY_BRIGHTNESS_MAX) {
+        blankingDelay = 0;
+    } else {
+        blankingDelay = level * (DISPLAY_PHASE_US / DISPLAY_BRIGHTNESS_MAX);
+    }
+}
+
+/**
+ * @brief Schedules blanking of the display when it is dimmed.
+ */
+static void startBlanking()
+{
+    uint16_t t;
+
+    if (blankingDelay == 0) {
+        return;
+    }
+
+    // The high byte must be read first to latch the low byte.
+    t = (uint16_t) TIM2_CNTRH << 8;
+    t = (t | TIM2_CNTRL) + blankingDelay;
+
+    // The compare is disabled until the low byte is written.
+    TIM2_CCR1H = (uint8_t) (t >> 8);
+    TIM2_CCR1L = (uint8_t) t;
+    TIM2_SR1 &= ~TIM_SR1_CC1IF;
+    TIM2_IER |= TIM_IER_CC1IE;
+}
+
+#ifndef CONFIG_USE_DIGIT_MULTIPLEX
 /**
  * @brief
  * Enable the segment with given ID on SSD and remaining of segments are unchanged.
@@ -194,11 +297,67 @@ static void enableSegment (bool set)
     else
         *rdport &= ~seg;
 }
+#endif
+
+#ifdef CONFIG_USE_DIGIT_MULTIPLEX
+/**
+ * @brief Disables all digits of the display.
+ */
+static void disableDigits()
+{
+    SSD_DIGIT_12_PORT |= SSD_DIGIT_1_BIT | SSD_DIGIT_2_BIT;
+    SSD_DIGIT_3_PORT |= SSD_DIGIT_3_BIT;
+}
+
+/**
+ * @brief This function is being called during timer's interrupt
+ *  request so keep it extremely small and fast. During this call
+ *  the next digit is shown by writing its precomputed output bytes
+ *  to the segment ports and the digit port.
+ */
+void refreshDisplay()
+{
+    const uint8_t *ports;
+
+    disableDigits();
+
+    if (displayOff) {
+        return;
+    }
+
+    // Flip to the last painted frame at the multiplex cycle boundary.
+    if (++activeDigitId >= 3) {
+        activeDigitId = 0;
+        frontFrame = readyFrame;
+    }
+
+    ports = &frames[frontFrame][activeDigitId * PORTS_PER_DIGIT];
+
+    SSD_SEG_BF_PORT = (SSD_SEG_BF_PORT & ~SSD_BF_PORT_MASK) | ports[PORT_BF];
+    SSD_SEG_CG_PORT = (SSD_SEG_CG_PORT & ~SSD_CG_PORT_MASK) | ports[PORT_CG];
+    SSD_SEG_AEDP_PORT = (SSD_SEG_AEDP_PORT & ~(SSD_AEDP_PORT_MASK | SSD_DIGIT_3_BIT) )
+                        | ports[PORT_AEDP];
+    SSD_DIGIT_12_PORT = (SSD_DIGIT_12_PORT & ~(SSD_DIGIT_1_BIT | SSD_DIGIT_2_BIT) )
+                        | ports[PORT_DIGIT_12];
+    startBlanking();
+}
 
+void displayBeep()
+{
+#ifdef CONFIG_USE_DISPLAY_BUZZ
+    // Keep the P segment lit and toggle the first digit only.
+    SSD_SEG_BF_PORT &= ~SSD_BF_PORT_MASK;
+    SSD_SEG_CG_PORT &= ~SSD_CG_PORT_MASK;
+    SSD_SEG_AEDP_PORT = (SSD_SEG_AEDP_PORT & ~SSD_AEDP_PORT_MASK)
+                        | SSD_SEG_P_BIT | SSD_DIGIT_3_BIT;
+    SSD_DIGIT_12_PORT = (SSD_DIGIT_12_PORT | SSD_DIGIT_2_BIT) ^ SSD_DIGIT_1_BIT;
+#endif
+}
+#else
 static void enableDigits ()
 {
     uint8_t rdport;
-    uint8_t digits = display[activeSegId];
+    uint8_t digits = frames[frontFrame][activeSegId];
 
     rdport = SSD_DIGIT_3_PORT & ~SSD_DIGIT_3_BIT;
     SSD_DIGIT_3_PORT = (digits & DIGIT_3)? rdport | SSD_DIGIT_3_BIT : rdport;
@@ -223,9 +382,16 @@ void refreshDisplay()
     }
 
     activeSegId = (activeSegId + 1) & 0x7;
+
+    // Flip to the last painted frame at the multiplex cycle boundary.
+    if (activeSegId == 0) {
+        frontFrame = readyFrame;
+    }
+
     enableDigits();
 
     enableSegment (true);
+    startBlanking();
 }
 
 void displayBeep()
@@ -233,10 +399,28 @@ void displayBeep()
 #ifdef CONFIG_USE_DISPLAY_BUZZ
     enableSegment (false);
     activeSegId = SEG_P;
-    display[activeSegId] |= ~DIGIT_1;
-    display[activeSegId] ^= DIGIT_1;
+    frames[frontFrame][activeSegId] |= ~DIGIT_1;
+    frames[frontFrame][activeSegId] ^= DIGIT_1;
     enableDigits();
     enableSegment (true);
+    repaint = true;
+#endif
+}
+#endif
+
+/**
+ * @brief This function is TIM2 capture/compare interrupt request handler.
+ *  It blanks the display for the rest of the multiplex phase.
+ */
+void TIM2_CC_handler() __interrupt (14)
+{
+    TIM2_SR1 &= ~TIM_SR1_CC1IF;
+    TIM2_IER &= ~TIM_IER_CC1IE;
+
+#ifdef CONFIG_USE_DIGIT_MULTIPLEX
+    disableDigits();
+#else
+    enableSegment (false);
 #endif
 }
 
@@ -275,13 +459,44 @@ void setDisplayOff (bool val)
  */
 static void paintChar(uint8_t mask, uint8_t id)
 {
-    int8_t i;
+    uint8_t i;
+    uint8_t *display;
+
+    // Start the new frame from the copy of the ready one.
+    if (backFrame == NO_FRAME) {
+        backFrame = (frontFrame + 1) % N_FRAMES;
+
+        if (backFrame == readyFrame) {
+            backFrame = (backFrame + 1) % N_FRAMES;
+        }
+
+        memcpy (frames[backFrame], frames[readyFrame], sizeof frames[0]);
+    }
+
+    display = frames[backFrame];
+
+#ifdef CONFIG_USE_DIGIT_MULTIPLEX
+    display += (id == DIGIT_1)? 0:
+               (id == DIGIT_2)? PORTS_PER_DIGIT:
+                                2 * PORTS_PER_DIGIT;
+
+    // The digit itself is enabled by low level and the rest are disabled.
+    display[PORT_BF] = 0;
+    display[PORT_CG] = 0;
+    display[PORT_AEDP] = (id == DIGIT_3)? 0: SSD_DIGIT_3_BIT;
+    display[PORT_DIGIT_12] = (SSD_DIGIT_1_BIT | SSD_DIGIT_2_BIT) & ~id;
 
+    for (i = 0; i < 8; i++, mask >>= 1)
+        if (mask & 1)
+            display[(i <= SEG_F)? PORT_BF: (i <= SEG_G)? PORT_CG: PORT_AEDP] |=
+                displaySegment[i];
+#else
     for (i = 0; i < 8; i++, mask >>= 1)
         if (mask & 1)
             display[i] &= ~id;
         else
             display[i] |= id;
+#endif
 }
 
 
@@ -299,7 +514,7 @@ static void paintChar(uint8_t mask, uint8_t id)
  *  schematic manner.
  *  Accepted values are: ANY.
  *  But only actual characters are defined. For the rest of values the
- *  '_' symbol is shown.
+ *  digit is left blank.
  * @param dot
  *  Enable dot (decimal point) for the character.
  *  Accepted values true/false.
@@ -312,20 +527,31 @@ static void setDigit (uint8_t id, uint8_t val, bool dot)
 #else
     static const uint8_t digitVec[] = {DIGIT_3, DIGIT_2, DIGIT_1};
 #endif
-    uint8_t mask;
-    const uint8_t *p;
+    uint8_t mask = 0;
 
     if (id > 2) return;
 
     if (testMode) return;
 
-    for (p = font; p[0]; p += 2)
-        if (p[0] == val) break;
-    mask = p[1];
+    if (val >= FONT_LOWER_FIRST) {
+        val -= FONT_LOWER_FIRST - FONT_LOWER_OFFSET;
+    } else if (val > FONT_UPPER_LAST) {
+        val = sizeof font;
+    } else {
+        val -= FONT_UPPER_FIRST;
+    }
+
+    if (val < sizeof font)
+        mask = font[val];
 
     if (dot)
         mask |= bit(SEG_P);
 
+    // Nothing to do when the digit is shown already.
+    if (mask == glyph[id] && !repaint)
+        return;
+
+    glyph[id] = mask;
     paintChar(mask, digitVec[id]);
 }
 
@@ -337,14 +563,10 @@ static void setDigit (uint8_t id, uint8_t val, bool dot)
  */
 void setDisplayStr (const char *val)
 {
+    bool force = repaint;
 #ifdef RIGHT_ALIGN_TEXT
     uint8_t i, d;
 
-    // disable the digit if it is not needed.
-    for (i = 0; i < 3; i++) {
-        setDigit (i, ' ', false);
-    }
-
     // get number of display digit(s) required to show given string.
     for (i = 0, d = 0; val[i]; i++, d++) {
         if (val[i] == '.' && i > 0 && val[i-1] != '.') d--;
@@ -356,6 +578,11 @@ void setDisplayStr (const char *val)
         d = 3;
     }
 
+    // disable the digit if it is not needed.
+    for (i = d; i < 3; i++) {
+        setDigit (i, ' ', false);
+    }
+
     // set values for digits.
     for (i = 0; d != 0 && val[i]; i++, d--) {
         uint8_t c = val[i];
@@ -386,6 +613,17 @@ void setDisplayStr (const char *val)
         setDigit (i, c, d);
     }
 #endif
+
+    // Display's buffer matches the glyphs again.
+    if (force && !testMode) {
+        repaint = false;
+    }
+
+    // Publish the new frame, it will be shown from the next multiplex cycle.
+    if (backFrame != NO_FRAME) {
+        readyFrame = backFrame;
+        backFrame = NO_FRAME;
+    }
 }
 
 /**
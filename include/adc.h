@@ -23,6 +23,8 @@
 void initADC();
 void startADC();
 int getTemperature();
+void updateTemperature();
+void updateAdcWatchdog();
 uint16_t getAdcFiltered();
 void ADC1_EOC_handler() __interrupt (22);
 
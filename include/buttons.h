@@ -43,10 +43,14 @@ bool getButton3();
 
 void buttonRetrigger(uint8_t keys, uint8_t timeout);
 
+uint8_t getButtonMultiplier();
+
 void buttonEnableLongPress(uint8_t keys);
 
 void refreshButtons(void);
 
 void EXTI2_handler() __interrupt (5);
 
+void TIM1_UPD_handler() __interrupt (11);
+
 #endif
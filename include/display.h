@@ -32,4 +32,9 @@ void itofpa (int val, char* str, uint8_t pointPosition);
 
 void displayBeep();
 
+#define DISPLAY_BRIGHTNESS_MAX  10
+
+void setDisplayBrightness (uint8_t level);
+void TIM2_CC_handler() __interrupt (14);
+
 #endif
@@ -22,30 +22,45 @@
 #include <stdbool.h>
 
 /* Menu sections */
-#define MENU_INIT          0
-#define MENU_ROOT          1
-#define MENU_SELECT_PARAM  2
-#define MENU_CHANGE_PARAM  3
-#define MENU_SET_TIMER     4
-#define MENU_TIMER_RUNNING 5
-#define MENU_TIMER_FINISHED 6
+enum {
+    MENU_INIT,
+    MENU_ROOT,
+    MENU_SELECT_PARAM,
+    MENU_CHANGE_PARAM,
+    MENU_SET_TIMER,
+    MENU_TIMER_RUNNING,
+    MENU_TIMER_FINISHED,
+    MENU_ALARM,
+    MENU_AUTOTUNE,
+    MENU_PROFILE,
+    MENU_STATES         /* Number of menu sections, keep it last */
+};
 
 /* Menu events */
-#define MENU_EVENT_PUSH_BUTTON1     1
-#define MENU_EVENT_PUSH_BUTTON2     2
-#define MENU_EVENT_PUSH_BUTTON3     3
+enum {
+    MENU_EVENT_PUSH_BUTTON1 = 1,
+    MENU_EVENT_PUSH_BUTTON2,
+    MENU_EVENT_PUSH_BUTTON3,
 
-#define MENU_EVENT_RELEASE_BUTTON1  4
-#define MENU_EVENT_RELEASE_BUTTON2  5
-#define MENU_EVENT_RELEASE_BUTTON3  6
+    MENU_EVENT_RELEASE_BUTTON1,
+    MENU_EVENT_RELEASE_BUTTON2,
+    MENU_EVENT_RELEASE_BUTTON3,
 
-#define MENU_EVENT_LONGPRESS_BUTTON1 7
-#define MENU_EVENT_LONGPRESS_BUTTON2 8
-#define MENU_EVENT_LONGPRESS_BUTTON3 9
+    MENU_EVENT_LONGPRESS_BUTTON1,
+    MENU_EVENT_LONGPRESS_BUTTON2,
+    MENU_EVENT_LONGPRESS_BUTTON3,
 
-#define MENU_EVENT_CHECK_TIMER      10
+    MENU_EVENT_CHECK_TIMER,
+    MENU_EVENT_ALARM,
+    MENU_EVENTS         /* Number of menu events, keep it last */
+};
+
+/* Compile-time check of a table indexed by menu section or event,
+ * the size of the array turns negative when the condition fails. */
+#define MENU_TABLE_CHECK(name, cond)    typedef char name[(cond)? 1: -1]
 
 void initMenu();
+void postMenuEvent (uint8_t event);
 void refreshMenu();
 uint8_t getMenuDisplay();
 void feedMenu (uint8_t event);
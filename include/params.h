@@ -32,9 +32,16 @@
     PARAM(PARAM_RELAY_DELAY,               0,  10,    0,   1, DISPLAY_NUM_INT    ), \
     PARAM(PARAM_OVERHEAT_INDICATION,       0,   1,    0,   1, DISPLAY_STR_OFF_ON ), \
     PARAM(PARAM_THRESHOLD,               300, 550,  440,   5, DISPLAY_NUM_FRACT_1), \
+    PARAM(PARAM_PID_MODE,                  0,   1,    0,   1, DISPLAY_STR_OFF_ON ), \
+    PARAM(PARAM_CLOCK_TRIM,              -99,  99,    0,   1, DISPLAY_NUM_INT    ), \
+    PARAM(PARAM_BRIGHTNESS,                1,  10,   10,   1, DISPLAY_NUM_INT    ), \
     /* Parameters from magic_id and up is not available in parameter selection:  */ \
     PARAM(PARAM_MAGIC_ID,                  0,   0, PARAM_MAGIC_VERSION,  0, DISPLAY_STR_NONE   ), \
-    PARAM(PARAM_FERMENTATION_TIME,         1,  15,    8,   1, DISPLAY_NUM_INT    ), \
+    PARAM(PARAM_FERMENTATION_TIME,         1,  48,    8,   1, DISPLAY_NUM_INT    ), \
+    PARAM(PARAM_PID_KP,                    0, 9999, 100,   1, DISPLAY_NUM_INT    ), \
+    PARAM(PARAM_PID_KI,                    0, 9999,   2,   1, DISPLAY_NUM_INT    ), \
+    PARAM(PARAM_PID_KD,                    0, 9999, 500,   1, DISPLAY_NUM_INT    ), \
+    PARAM(PARAM_OVERSHOOT,                 0, 100,    0,   1, DISPLAY_NUM_FRACT_1), \
 
 
 /* enumerate the parameters */
@@ -57,8 +64,8 @@ void decParamId();
 
 int getParamById (uint8_t);
 void setParamById (uint8_t, int);
-void incParam();
-void decParam();
+void incParam (uint8_t times);
+void decParam (uint8_t times);
 
 void paramToString (uint8_t, char*);
 
@@ -19,11 +19,21 @@
 #define PERSIST_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "params.h"
 
 /* Define size of persistent storage */
-#define SZ_PARAMETER 10  /* Size of parameter structure */
+#define SZ_PARAMETER N_PARAMETERS  /* Size of parameter structure */
+#define SZ_JOURNAL   23            /* Number of slots in the journal ring */
 
-typedef int ee_persist_t ; /* Parameter type */
+typedef int16_t ee_persist_t ; /* Parameter type */
+
+/* Journal record, the sequence number is maintained by the journal itself */
+typedef struct {
+    uint8_t seq;
+    uint8_t flags;
+    uint16_t minutes;
+} ee_journal_t;
 
 /**
  * @brief Stores updated parameters from array 'params' to EEPROM.
@@ -37,6 +47,18 @@ void ee_storeParams(const ee_persist_t *params);
 void ee_loadParams(ee_persist_t *params);
 
 
+/**
+ * @brief Appends a record to the journal ring in EEPROM.
+ */
+void ee_storeJournal(const ee_journal_t *rec);
+
+
+/**
+ * @brief Finds the most recent record of the journal ring in EEPROM.
+ */
+bool ee_loadJournal(ee_journal_t *rec);
+
+
 /**
  * @brief Write single value to persistent storage
  * @param val
@@ -0,0 +1,54 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Profiled interrupt handlers */
+#define PROFILE_TIM4    0
+#define PROFILE_ADC     1
+#define PROFILE_EXTI    2
+#define PROFILE_HANDLERS 3
+
+/* Statistics kept per handler */
+#define PROFILE_MIN     0
+#define PROFILE_AVG     1
+#define PROFILE_MAX     2
+#define PROFILE_ITEMS   (PROFILE_HANDLERS * 3)
+
+#ifdef CONFIG_ENABLE_PROFILER
+
+#define PROFILE_ENTER(id)   profileEnter (id)
+#define PROFILE_EXIT(id)    profileExit (id)
+
+void initProfiler();
+void profileEnter (uint8_t id);
+void profileExit (uint8_t id);
+void selectProfileItem (bool next);
+void profileItemToString (char *strBuff, bool label);
+
+#else
+
+#define PROFILE_ENTER(id)
+#define PROFILE_EXIT(id)
+
+#endif
+
+#endif
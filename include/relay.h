@@ -21,10 +21,21 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/* Autotune states, the running state is the number of the current cycle */
+#define AUTOTUNE_OFF    0
+#define AUTOTUNE_DONE   0xFF
+
 void initRelay();
 void buzzRelay ();
 void refreshRelay();
+void updateRelayControl();
 bool isRelayEnabled();
 void enableRelay (bool state);
+void tripRelay();
+void resetRelayTrip();
+bool isRelayTripped();
+void startAutotune();
+void stopAutotune();
+uint8_t getAutotuneState();
 
 #endif
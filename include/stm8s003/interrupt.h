@@ -0,0 +1,33 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STM8S003_INTERRUPT_H
+#define STM8S003_INTERRUPT_H
+
+#ifndef INTERRUPT_ENABLE
+#define INTERRUPT_ENABLE()    do {__asm rim __endasm; } while(0)
+#endif
+
+#ifndef INTERRUPT_DISABLE
+#define INTERRUPT_DISABLE()   do {__asm sim __endasm; } while(0)
+#endif
+
+#ifndef WAIT_FOR_INTERRUPT
+#define WAIT_FOR_INTERRUPT()  do {__asm wfi __endasm; } while(0)
+#endif
+
+#endif
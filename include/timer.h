@@ -21,9 +21,17 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/* Tasks posted by the timer's interrupt to be run from the main loop */
+#define TIMER_TASK_ADC      0x04
+#define TIMER_TASK_RELAY    0x08
+#define TIMER_TASK_JOURNAL  0x10
+
 void initTimer();
 void startFTimer();
 void stopFTimer();
+void storeFTimer();
+void pauseFTimer (bool);
+bool isFTimerPaused();
 void resetUptime();
 bool isFTimer();
 uint32_t getUptime();
@@ -31,8 +39,9 @@ uint16_t getUptimeTicks();
 uint8_t getUptimeSeconds();
 uint8_t getUptimeMinutes();
 uint8_t getUptimeHours();
-uint8_t getUptimeDays();
+uint16_t getUptimeDays();
 void uptimeToString (char*, const char*);
+uint8_t takeTimerTasks();
 void TIM4_UPD_handler() __interrupt (23);
 
 void enableBeep(uint8_t set);
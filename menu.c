@@ -19,23 +19,38 @@
  * Implementation of application menu.
  */
 
+#include <stddef.h>
 #include "menu.h"
 #include "buttons.h"
 #include "display.h"
 #include "params.h"
 #include "timer.h"
 #include "relay.h"
+#include "profile.h"
 
 #define MENU_1_SEC_PASSED   32
 #define MENU_3_SEC_PASSED   MENU_1_SEC_PASSED * 3
 #define MENU_5_SEC_PASSED   MENU_1_SEC_PASSED * 5
 #define MENU_AUTOINC_DELAY  MENU_1_SEC_PASSED / 4
 
+/* Size of the event queue, must be a power of two */
+#define MENU_QUEUE_SIZE     8
+/* Slots kept for one MENU_EVENT_CHECK_TIMER and one MENU_EVENT_ALARM */
+#define MENU_QUEUE_RESERVED 2
+
 static uint8_t menuState;
-/* Timer counter of menu. Being incremented on every call of refreshMenu() function.
+/* Timer counter of menu. Being incremented on every MENU_EVENT_CHECK_TIMER event.
  * Used to handle menu timeouts and handling of actions on holding a button. */
 static unsigned int timer;
 
+/* Queue of events posted by interrupts. Head is only written by producer
+ * and tail by consumer, so no locking is needed. */
+static uint8_t queue[MENU_QUEUE_SIZE];
+static volatile uint8_t queueHead;
+static volatile uint8_t queueTail;
+static volatile bool timerQueued;
+static volatile bool alarmQueued;
+
 /**
  * @brief Initialization of local variables.
  */
@@ -43,6 +58,46 @@ void initMenu()
 {
     timer = 0;
     menuState = MENU_INIT;
+    queueHead = 0;
+    queueTail = 0;
+    timerQueued = false;
+    alarmQueued = false;
+}
+
+/**
+ * @brief Queues an event for the menu. Must be called from interrupts
+ *  only, the interrupts don't preempt each other so there is a single
+ *  producer. MENU_EVENT_CHECK_TIMER and MENU_EVENT_ALARM are queued once
+ *  until they are handled and always find a reserved slot. The button
+ *  events are dropped when the rest of the queue is full.
+ * @param event
+ *  one of MENU_EVENT_* values.
+ */
+void postMenuEvent (uint8_t event)
+{
+    uint8_t head = queueHead;
+
+    if (event == MENU_EVENT_CHECK_TIMER) {
+        if (timerQueued) {
+            return;
+        }
+    } else if (event == MENU_EVENT_ALARM) {
+        if (alarmQueued) {
+            return;
+        }
+    } else if ( (uint8_t) (head - queueTail) >=
+                MENU_QUEUE_SIZE - MENU_QUEUE_RESERVED) {
+        return;
+    }
+
+    queue[head & (MENU_QUEUE_SIZE - 1)] = event;
+    queueHead = head + 1;
+
+    if (event == MENU_EVENT_CHECK_TIMER) {
+        timerQueued = true;
+    } else if (event == MENU_EVENT_ALARM) {
+        alarmQueued = true;
+    }
 }
 
 /**
@@ -54,28 +109,371 @@ uint8_t getMenuDisplay()
     return menuState;
 }
 
+/* Pseudo state: stay in the current state */
+#define MENU_STAY           0xFF
+
 /**
  * @brief check for timeout in the state machine.
  */
-static void checkTimeout()
+static uint8_t checkTimeout (uint8_t next)
+{
+    if (timer <= MENU_5_SEC_PASSED) {
+        return next;
+    }
+
+    setParamId (0);
+    if (menuState != MENU_ROOT)
+        storeParams();
+    timer = 0;
+    return MENU_ROOT;
+}
+
+/**
+ * @brief Sets long-press for P8 (PID mode) to start autotune
+ *  and for P0 to show the hidden profiler statistics.
+ */
+static void selectParamLongPress()
+{
+#ifdef CONFIG_ENABLE_PROFILER
+    buttonEnableLongPress( (getParamId() == PARAM_PID_MODE || getParamId() == 0)?
+                           BUTTON1_BIT: 0);
+#else
+    buttonEnableLongPress( (getParamId() == PARAM_PID_MODE)? BUTTON1_BIT: 0);
+#endif
+}
+
+/*
+ * Actions of the transitions. Each action gets the next state from the
+ * transition table and returns the state to go to, MENU_STAY to remain.
+ */
+
+static uint8_t initCheck (uint8_t next)
+{
+    // Go on with the fermentation interrupted by power loss.
+    if (isFTimer() ) {
+        return MENU_TIMER_RUNNING;
+    }
+
+    return (timer > MENU_1_SEC_PASSED)? next: MENU_STAY;
+}
+
+static uint8_t latchAlarm (uint8_t next)
+{
+    // Latch the alarm when the relay is tripped by out-of-range temperature.
+    stopAutotune();
+    enableBeep(false);
+    return next;
+}
+
+static uint8_t setTimer (uint8_t next)
+{
+    setParamId (PARAM_FERMENTATION_TIME);
+    return next;
+}
+
+static uint8_t selectParam (uint8_t next)
+{
+    setParamId (0);
+    return next;
+}
+
+static uint8_t toggleRelay (uint8_t next)
+{
+    // Enable/Disable thermostat
+    if ( !isFTimer() ) {
+        enableRelay ( !isRelayEnabled() );
+    }
+    timer = 0;
+    return next;
+}
+
+static uint8_t startTimer (uint8_t next)
+{
+    startFTimer();
+    enableRelay (true);
+    return next;
+}
+
+static uint8_t storeAndStartTimer (uint8_t next)
+{
+    storeParams();
+    return startTimer (next);
+}
+
+static uint8_t pauseTimer (uint8_t next)
+{
+    pauseFTimer ( !isFTimerPaused() );
+    return next;
+}
+
+static uint8_t runningCheck (uint8_t next)
+{
+    return isFTimer()? MENU_STAY: next;
+}
+
+static uint8_t stopBeep (uint8_t next)
+{
+    enableBeep(false);
+    return next;
+}
+
+static uint8_t resetAlarm (uint8_t next)
+{
+    resetRelayTrip();
+    return isFTimer()? MENU_TIMER_RUNNING: next;
+}
+
+static uint8_t abortAutotune (uint8_t next)
+{
+    stopAutotune();
+    return next;
+}
+
+static uint8_t autotuneCheck (uint8_t next)
+{
+    if (getAutotuneState() == AUTOTUNE_DONE) {
+        setParamById (PARAM_PID_MODE, true);
+        storeParams();
+        stopAutotune();
+    }
+
+    return (getAutotuneState() == AUTOTUNE_OFF)? next: MENU_STAY;
+}
+
+static uint8_t longPressParam (uint8_t next)
+{
+#ifdef CONFIG_ENABLE_PROFILER
+    if (getParamId() == 0) {
+        return MENU_PROFILE;
+    }
+#endif
+    storeParams();
+    setParamId (0);
+    startAutotune();
+    enableRelay (true);
+    return next;
+}
+
+static uint8_t nextParam (uint8_t next)
+{
+    incParamId();
+    selectParamLongPress();
+    buttonRetrigger(BUTTON2_BIT, MENU_AUTOINC_DELAY);
+    timer = 0;
+    return next;
+}
+
+static uint8_t prevParam (uint8_t next)
+{
+    decParamId();
+    selectParamLongPress();
+    buttonRetrigger(BUTTON3_BIT, MENU_AUTOINC_DELAY);
+    timer = 0;
+    return next;
+}
+
+static uint8_t incValue (uint8_t next)
+{
+    incParam (getButtonMultiplier() );
+    buttonRetrigger(BUTTON2_BIT, MENU_AUTOINC_DELAY);
+    timer = 0;
+    return next;
+}
+
+static uint8_t decValue (uint8_t next)
+{
+    decParam (getButtonMultiplier() );
+    buttonRetrigger(BUTTON3_BIT, MENU_AUTOINC_DELAY);
+    timer = 0;
+    return next;
+}
+
+static uint8_t setTimerCheck (uint8_t next)
 {
-    if (timer > MENU_5_SEC_PASSED) {
-        setParamId (0);
-        if (menuState != MENU_ROOT)
-            storeParams();
-        menuState = MENU_ROOT;
-        setDisplayOff (false);
-        timer = 0;
+    bool blink;
+
+    if ( getButton2() || getButton3() ) {
+        blink = false;
+    } else {
+        blink = (bool) ( (uint8_t) getUptimeTicks() & 0x80);
     }
+    setDisplayOff (blink);
+    return checkTimeout (next);
 }
 
+#ifdef CONFIG_ENABLE_PROFILER
+static uint8_t nextProfileItem (uint8_t next)
+{
+    selectProfileItem (true);
+    return next;
+}
+
+static uint8_t prevProfileItem (uint8_t next)
+{
+    selectProfileItem (false);
+    return next;
+}
+#endif
+
+/* Transitions of the state machine */
+enum {
+    T_NONE,
+    T_ALARM,
+    T_INIT_CHECK,
+    T_TIMEOUT,
+    T_SET_TIMER,
+    T_SELECT_PARAM,
+    T_TOGGLE_RELAY,
+    T_START_TIMER,
+    T_PAUSE_TIMER,
+    T_RUNNING_CHECK,
+    T_STOP_BEEP,
+    T_RESET_ALARM,
+    T_ABORT_AUTOTUNE,
+    T_AUTOTUNE_CHECK,
+    T_BACK_TO_SELECT,
+    T_CHANGE_PARAM,
+    T_LONGPRESS_PARAM,
+    T_NEXT_PARAM,
+    T_PREV_PARAM,
+    T_INC_VALUE,
+    T_DEC_VALUE,
+    T_STORE_START_TIMER,
+    T_SET_TIMER_CHECK,
+#ifdef CONFIG_ENABLE_PROFILER
+    T_NEXT_PROFILE_ITEM,
+    T_PREV_PROFILE_ITEM,
+#endif
+    T_TRANSITIONS       /* Number of transitions, keep it last */
+};
+
+static const struct {
+    uint8_t (*action) (uint8_t next);
+    uint8_t next;
+} transitions[] = {
+    [T_NONE]                = {NULL,               MENU_STAY},
+    [T_ALARM]               = {latchAlarm,         MENU_ALARM},
+    [T_INIT_CHECK]          = {initCheck,          MENU_ROOT},
+    [T_TIMEOUT]             = {checkTimeout,       MENU_STAY},
+    [T_SET_TIMER]           = {setTimer,           MENU_SET_TIMER},
+    [T_SELECT_PARAM]        = {selectParam,        MENU_SELECT_PARAM},
+    [T_TOGGLE_RELAY]        = {toggleRelay,        MENU_STAY},
+    [T_START_TIMER]         = {startTimer,         MENU_TIMER_RUNNING},
+    [T_PAUSE_TIMER]         = {pauseTimer,         MENU_STAY},
+    [T_RUNNING_CHECK]       = {runningCheck,       MENU_TIMER_FINISHED},
+    [T_STOP_BEEP]           = {stopBeep,           MENU_ROOT},
+    [T_RESET_ALARM]         = {resetAlarm,         MENU_ROOT},
+    [T_ABORT_AUTOTUNE]      = {abortAutotune,      MENU_ROOT},
+    [T_AUTOTUNE_CHECK]      = {autotuneCheck,      MENU_ROOT},
+    [T_BACK_TO_SELECT]      = {NULL,               MENU_SELECT_PARAM},
+    [T_CHANGE_PARAM]        = {NULL,               MENU_CHANGE_PARAM},
+    [T_LONGPRESS_PARAM]     = {longPressParam,     MENU_AUTOTUNE},
+    [T_NEXT_PARAM]          = {nextParam,          MENU_STAY},
+    [T_PREV_PARAM]          = {prevParam,          MENU_STAY},
+    [T_INC_VALUE]           = {incValue,           MENU_STAY},
+    [T_DEC_VALUE]           = {decValue,           MENU_STAY},
+    [T_STORE_START_TIMER]   = {storeAndStartTimer, MENU_TIMER_RUNNING},
+    [T_SET_TIMER_CHECK]     = {setTimerCheck,      MENU_STAY},
+#ifdef CONFIG_ENABLE_PROFILER
+    [T_NEXT_PROFILE_ITEM]   = {nextProfileItem,    MENU_STAY},
+    [T_PREV_PROFILE_ITEM]   = {prevProfileItem,    MENU_STAY},
+#endif
+};
+
+MENU_TABLE_CHECK (transitionsSize,
+                  sizeof transitions / sizeof transitions[0] == T_TRANSITIONS);
+
+/* Transition for every state and event, T_NONE when the event is ignored.
+ * Every state must have its row. */
+static const uint8_t menuTable[][MENU_EVENTS] = {
+    [MENU_INIT] = {
+        [MENU_EVENT_CHECK_TIMER]        = T_INIT_CHECK,
+        [MENU_EVENT_ALARM]              = T_ALARM,
+    },
+    [MENU_ROOT] = {
+        [MENU_EVENT_PUSH_BUTTON1]       = T_SET_TIMER,
+        [MENU_EVENT_LONGPRESS_BUTTON1]  = T_SELECT_PARAM,
+        [MENU_EVENT_LONGPRESS_BUTTON2]  = T_TOGGLE_RELAY,
+        [MENU_EVENT_LONGPRESS_BUTTON3]  = T_START_TIMER,
+        [MENU_EVENT_CHECK_TIMER]        = T_TIMEOUT,
+        [MENU_EVENT_ALARM]              = T_ALARM,
+    },
+    [MENU_SELECT_PARAM] = {
+        [MENU_EVENT_PUSH_BUTTON1]       = T_CHANGE_PARAM,
+        [MENU_EVENT_PUSH_BUTTON2]       = T_NEXT_PARAM,
+        [MENU_EVENT_PUSH_BUTTON3]       = T_PREV_PARAM,
+        [MENU_EVENT_LONGPRESS_BUTTON1]  = T_LONGPRESS_PARAM,
+        [MENU_EVENT_CHECK_TIMER]        = T_TIMEOUT,
+        [MENU_EVENT_ALARM]              = T_ALARM,
+    },
+    [MENU_CHANGE_PARAM] = {
+        [MENU_EVENT_PUSH_BUTTON1]       = T_BACK_TO_SELECT,
+        [MENU_EVENT_PUSH_BUTTON2]       = T_INC_VALUE,
+        [MENU_EVENT_PUSH_BUTTON3]       = T_DEC_VALUE,
+        [MENU_EVENT_CHECK_TIMER]        = T_TIMEOUT,
+        [MENU_EVENT_ALARM]              = T_ALARM,
+    },
+    [MENU_SET_TIMER] = {
+        [MENU_EVENT_PUSH_BUTTON1]       = T_STORE_START_TIMER,
+        [MENU_EVENT_PUSH_BUTTON2]       = T_INC_VALUE,
+        [MENU_EVENT_PUSH_BUTTON3]       = T_DEC_VALUE,
+        [MENU_EVENT_CHECK_TIMER]        = T_SET_TIMER_CHECK,
+        [MENU_EVENT_ALARM]              = T_ALARM,
+    },
+    [MENU_TIMER_RUNNING] = {
+        [MENU_EVENT_PUSH_BUTTON1]       = T_PAUSE_TIMER,
+        [MENU_EVENT_CHECK_TIMER]        = T_RUNNING_CHECK,
+        [MENU_EVENT_ALARM]              = T_ALARM,
+    },
+    [MENU_TIMER_FINISHED] = {
+        [MENU_EVENT_PUSH_BUTTON1]       = T_STOP_BEEP,
+        [MENU_EVENT_PUSH_BUTTON2]       = T_STOP_BEEP,
+        [MENU_EVENT_PUSH_BUTTON3]       = T_STOP_BEEP,
+        [MENU_EVENT_ALARM]              = T_ALARM,
+    },
+    [MENU_ALARM] = {
+        [MENU_EVENT_PUSH_BUTTON1]       = T_RESET_ALARM,
+        [MENU_EVENT_PUSH_BUTTON2]       = T_RESET_ALARM,
+        [MENU_EVENT_PUSH_BUTTON3]       = T_RESET_ALARM,
+    },
+    [MENU_AUTOTUNE] = {
+        [MENU_EVENT_PUSH_BUTTON1]       = T_ABORT_AUTOTUNE,
+        [MENU_EVENT_PUSH_BUTTON2]       = T_ABORT_AUTOTUNE,
+        [MENU_EVENT_PUSH_BUTTON3]       = T_ABORT_AUTOTUNE,
+        [MENU_EVENT_CHECK_TIMER]        = T_AUTOTUNE_CHECK,
+        [MENU_EVENT_ALARM]              = T_ALARM,
+    },
+    [MENU_PROFILE] = {
+#ifdef CONFIG_ENABLE_PROFILER
+        [MENU_EVENT_PUSH_BUTTON1]       = T_BACK_TO_SELECT,
+        [MENU_EVENT_PUSH_BUTTON2]       = T_NEXT_PROFILE_ITEM,
+        [MENU_EVENT_PUSH_BUTTON3]       = T_PREV_PROFILE_ITEM,
+#endif
+        [MENU_EVENT_ALARM]              = T_ALARM,
+    },
+};
+
+MENU_TABLE_CHECK (menuTableSize,
+                  sizeof menuTable / sizeof menuTable[0] == MENU_STATES);
+
+/* Keys with long-press enabled in each state */
+static const uint8_t menuLongPress[MENU_STATES] = {
+    [MENU_ROOT] = BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT,
+};
+
 /**
  * @brief Updating state of application's menu and displaying info when new
- *  event is received. Possible states of menu and displaying are:
+ *  event is received. The transition is looked up in the table by the
+ *  current state and the event. The entry actions of the new state are
+ *  run only when the state is changed. Possible states of menu and
+ *  displaying are:
  *  MENU_ROOT
  *  MENU_SELECT_PARAM
  *  MENU_CHANGE_PARAM
  *  MENU_SET_TIMER
+ *  MENU_ALARM
+ *  MENU_AUTOTUNE
+ *  MENU_PROFILE (with CONFIG_ENABLE_PROFILER)
  *
  * @param event is one of:
  *  MENU_EVENT_PUSH_BUTTON1
@@ -88,199 +486,61 @@ static void checkTimeout()
  *  MENU_EVENT_LONGPRESS_BUTTON2
  *  MENU_EVENT_LONGPRESS_BUTTON3
  *  MENU_EVENT_CHECK_TIMER
+ *  MENU_EVENT_ALARM
  */
 void feedMenu (uint8_t event)
 {
-    bool blink;
-
-    if (menuState == MENU_INIT) {
-        switch (event) {
-        case MENU_EVENT_CHECK_TIMER:
-            if (timer > MENU_1_SEC_PASSED) {
-                timer = 0;
-                menuState = MENU_ROOT;
-            }
+    uint8_t t, next;
 
-        default:
-            ;
-        }
-    }
-    else if (menuState == MENU_ROOT) {
-        buttonEnableLongPress(BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT);
-
-        switch (event) {
-        case MENU_EVENT_PUSH_BUTTON1:
-            setParamId (PARAM_FERMENTATION_TIME);
-            menuState = MENU_SET_TIMER;
-            timer = 0;
-            break;
-
-        case MENU_EVENT_LONGPRESS_BUTTON1:
-            setParamId (0);
-            menuState = MENU_SELECT_PARAM;
-            timer = 0;
-            break;
-
-        case MENU_EVENT_LONGPRESS_BUTTON2:    // Enable/Disable thermostat
-            if ( !isFTimer() ) {
-                if ( isRelayEnabled() ) {
-                    enableRelay (false);
-                }
-                else {
-                    enableRelay (true);
-                }
-            }
-            timer = 0;
-            break;
-
-        case MENU_EVENT_LONGPRESS_BUTTON3: // Start/Stop fermentation timer
-            startFTimer();
-            enableRelay (true);
-            menuState = MENU_TIMER_RUNNING;
-            timer = 0;
-            break;
-
-        case MENU_EVENT_CHECK_TIMER:
-            checkTimeout ();
-
-        default:
-            break;
-        }
-    }
-    else if (menuState == MENU_TIMER_RUNNING) {
-
-        buttonEnableLongPress(0);
-
-        switch (event) {
-        case MENU_EVENT_CHECK_TIMER:
-            if ( !isFTimer() ) {
-                menuState = MENU_TIMER_FINISHED;
-                timer = 0;
-            }
-        default:
-            break;
-        }
-    }
-    else if (menuState == MENU_TIMER_FINISHED) {
-
-        switch (event) {
-        case MENU_EVENT_PUSH_BUTTON1:
-        case MENU_EVENT_PUSH_BUTTON2:
-        case MENU_EVENT_PUSH_BUTTON3:
-            enableBeep(false);
-            menuState = MENU_ROOT;
-            timer = 0;
-       default:
-            break;
-    	}
+    if (event >= MENU_EVENTS) {
+        return;
     }
-    else if (menuState == MENU_SELECT_PARAM) {
-
-        buttonEnableLongPress(0);
-
-        switch (event) {
-        case MENU_EVENT_PUSH_BUTTON1:
-            menuState = MENU_CHANGE_PARAM;
-            timer = 0;
-            break;
 
-        case MENU_EVENT_PUSH_BUTTON2:
-            incParamId();
-            buttonRetrigger(BUTTON2_BIT, MENU_AUTOINC_DELAY);
-            timer = 0;
-            break;
+    t = menuTable[menuState][event];
+    next = transitions[t].next;
 
-        case MENU_EVENT_PUSH_BUTTON3:
-            decParamId();
-            buttonRetrigger(BUTTON3_BIT, MENU_AUTOINC_DELAY);
-            timer = 0;
-            break;
-
-        case MENU_EVENT_CHECK_TIMER:
-            checkTimeout ();
-
-        default:
-            break;
-        }
-    } else if (menuState == MENU_CHANGE_PARAM) {
-
-        buttonEnableLongPress(0);
-
-        switch (event) {
-        case MENU_EVENT_PUSH_BUTTON1:
-            menuState = MENU_SELECT_PARAM;
-            timer = 0;
-            break;
-
-        case MENU_EVENT_PUSH_BUTTON2:
-            incParam();
-            buttonRetrigger(BUTTON2_BIT, MENU_AUTOINC_DELAY);
-            timer = 0;
-            break;
+    if (transitions[t].action != NULL) {
+        next = transitions[t].action (next);
+    }
 
-        case MENU_EVENT_PUSH_BUTTON3:
-            decParam();
-            buttonRetrigger(BUTTON3_BIT, MENU_AUTOINC_DELAY);
-            timer = 0;
-            break;
+    if (next == MENU_STAY || next == menuState) {
+        return;
+    }
 
-        case MENU_EVENT_CHECK_TIMER:
-            checkTimeout();
+    // Entry actions of the new state.
+    menuState = next;
+    timer = 0;
+    setDisplayOff (false);
+    buttonEnableLongPress (menuLongPress[next]);
 
-        default:
-            break;
-        }
-    } else if (menuState == MENU_SET_TIMER) {
-
-        buttonEnableLongPress(0);
-
-        switch (event) {
-        case MENU_EVENT_PUSH_BUTTON1:
-            menuState = MENU_TIMER_RUNNING;
-            storeParams();
-            startFTimer();
-            enableRelay (true);
-            setDisplayOff (false);
-            timer = 0;
-            break;
-
-        case MENU_EVENT_PUSH_BUTTON2:
-            incParam();
-            buttonRetrigger(BUTTON2_BIT, MENU_AUTOINC_DELAY);
-            timer = 0;
-            break;
-
-        case MENU_EVENT_PUSH_BUTTON3:
-            decParam();
-            buttonRetrigger(BUTTON3_BIT, MENU_AUTOINC_DELAY);
-            timer = 0;
-            break;
-
-        case MENU_EVENT_CHECK_TIMER:
-            if ( getButton2() || getButton3() ) {
-                blink = false;
-            } else {
-                blink = (bool) ( (uint8_t) getUptimeTicks() & 0x80);
-            }
-            setDisplayOff (blink);
-            checkTimeout();
-
-        default:
-            break;
-        }
+    if (next == MENU_SELECT_PARAM) {
+        selectParamLongPress();
     }
 }
 
 /**
- * @brief This function is being called during timer's interrupt
- *  request so keep it extremely small and fast.
- *  During this call all time-related functionality of application
+ * @brief This function is being called from the main loop on every
+ *  wakeup. The events queued by the interrupts are handled here.
+ *  On MENU_EVENT_CHECK_TIMER all time-related functionality of application
  *  menu is handled. For example: fast value change while holding
  *  a button, return to root menu when no action is received from
  *  user within a given time.
  */
 void refreshMenu()
 {
-    timer++;
-    feedMenu (MENU_EVENT_CHECK_TIMER);
+    uint8_t event;
+
+    while (queueTail != queueHead) {
+        event = queue[queueTail & (MENU_QUEUE_SIZE - 1)];
+        queueTail++;
+
+        if (event == MENU_EVENT_CHECK_TIMER) {
+            timerQueued = false;
+            timer++;
+        } else if (event == MENU_EVENT_ALARM) {
+            alarmQueued = false;
+        }
+
+        feedMenu (event);
+    }
 }
@@ -30,18 +30,21 @@
  * P5 - | 0 | 0 ... 10 Relay switching delay in minutes
  * P6 - |Off| On/Off Indication of overheating
  * P7 - | 44| 30.0 ... 55.0 Threshold value in degrees of Celsius
- * FT - | 8h| 1h ... 15h Fermentation time in hours
+ * P8 - |Off| On/Off Time-proportional PID control instead of hysteresis
+ * P9 - | 0 | -99 ... 99 Clock trim in 0.01%, positive value makes the clock run faster
+ * PA - | 10| 1 ... 10 Display brightness
+ * FT - | 8h| 1h ... 48h Fermentation time in hours
  */
 
 #include <stdint.h>
 
 #include "params.h"
+#include "adc.h"
+#include "relay.h"
 #include "buttons.h"
 #include "display.h"
 #include "persist.h"
 
-#define MAGIC          0x4E48
-
 /* Parameter Formattings */
 #define DISPLAY_NUM            0
 #define DISPLAY_NUM_FRACT_1    0    /* 12.3 */
@@ -79,7 +82,47 @@ static const struct parameterConf parameters[] = {
 };
 
 static uint8_t paramId;
-static int paramCache[N_PARAMETERS];
+static ee_persist_t paramCache[N_PARAMETERS];
+
+/**
+ * @brief Notifies the users of cached values derived from the parameter
+ *  with given id that its value is changed.
+ * @param id
+ */
+static void paramChanged (uint8_t id)
+{
+    switch (id) {
+    case PARAM_TEMPERATURE_CORRECTION:
+        updateTemperature();
+        updateAdcWatchdog();
+        break;
+
+    case PARAM_RELAY_MODE:
+        updateAdcWatchdog();
+        updateRelayControl();
+        break;
+
+    case PARAM_MAX_TEMPERATURE:
+    case PARAM_MIN_TEMPERATURE:
+        updateAdcWatchdog();
+        break;
+
+    case PARAM_BRIGHTNESS:
+        setDisplayBrightness ( (uint8_t) paramCache[PARAM_BRIGHTNESS]);
+        break;
+
+    case PARAM_RELAY_HYSTERESIS:
+    case PARAM_RELAY_DELAY:
+    case PARAM_THRESHOLD:
+    case PARAM_PID_MODE:
+    case PARAM_OVERSHOOT:
+        updateRelayControl();
+        break;
+
+    default:
+        break;
+    }
+}
 
 /**
  * @brief Stores updated parameters in paramCache to EEPROM.
@@ -99,7 +142,7 @@ void initParamsEEPROM(bool restore)
 
     ee_loadParams (paramCache);
 
-    if (paramCache[PARAM_MAGIC_ID] != MAGIC || restore) {
+    if (paramCache[PARAM_MAGIC_ID] != PARAM_MAGIC_VERSION || restore) {
 
         // Restore parameters to default values
         for (i = 0; i < N_PARAMETERS; i++) {
@@ -110,6 +153,10 @@ void initParamsEEPROM(bool restore)
     }
 
     paramId = 0;
+
+    for (i = 0; i < N_PARAMETERS; i++) {
+        paramChanged (i);
+    }
 }
 
 /**
@@ -135,41 +182,50 @@ void setParamById (uint8_t id, int val)
 {
     if (id < SZ_PARAMETER) {
         paramCache[id] = val;
+        paramChanged (id);
     }
 }
 
 /**
  * @brief Incrementing the value of the currently selected parameter.
+ * @param times
+ *  number of steps to increment by, the value stops at the maximum.
  */
-void incParam()
+void incParam (uint8_t times)
 {
     uint8_t i = paramId;
-    int v = paramCache[i] + parameters[i].step;
+    int v = paramCache[i] + parameters[i].step * times;
 
     /* Check if id is a switch style parameter */
     if (parameters[i].format < 0) {
         paramCache[i] ^= 0x0001;
     }
-    else if (v <= parameters[i].max) {
-        paramCache[i] = v;
+    else {
+        paramCache[i] = (v <= parameters[i].max)? v: parameters[i].max;
     }
+
+    paramChanged (i);
 }
 
 /**
  * @brief Decrementing the value of the currently selected parameter.
+ * @param times
+ *  number of steps to decrement by, the value stops at the minimum.
  */
-void decParam()
+void decParam (uint8_t times)
 {
     uint8_t i = paramId;
-    int v = paramCache[i] - parameters[i].step;
+    int v = paramCache[i] - parameters[i].step * times;
 
     /* Check if id is a switch style parameter */
     if (parameters[i].format < 0) {
         paramCache[i] ^= 0x0001;
     }
-    else if (v >= parameters[i].min) {
-        paramCache[i] = v;
+    else {
+        paramCache[i] = (v >= parameters[i].min)? v: parameters[i].min;
     }
+
+    paramChanged (i);
 }
 
 /**
@@ -16,13 +16,27 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "stm8s003/prom.h"
 #include "persist.h"
 
 
 /* Definitions for EEPROM */
 #define EEPROM_BASE_ADDR        0x4000
-#define EEPROM_PARAMS_OFFSET    100
+#define EEPROM_JOURNAL_OFFSET   0
+#define EEPROM_PARAMS_OFFSET    (EEPROM_JOURNAL_OFFSET + SZ_JOURNAL * sizeof (ee_journal_t) )
+#define EEPROM_SIZE             128
+
+/* The journal and the parameters must fit the EEPROM, the size of the
+ * array turns negative when they don't. */
+typedef char eepromSizeCheck[(EEPROM_PARAMS_OFFSET +
+                              SZ_PARAMETER * sizeof (ee_persist_t) <=
+                              EEPROM_SIZE)? 1: -1];
+
+/**
+ * Slot of the journal ring holding the most recent record.
+ */
+static uint8_t journalSlot;
 
 /**
  * @brief Write protect the EEPROM.
@@ -81,6 +95,66 @@ void ee_loadParams(ee_persist_t *params)
     }
 }
 
+/**
+ * @brief Appends a record to the journal ring in EEPROM.
+ *  Every record goes to the slot next to the most recent one, so the
+ *  writes are spread evenly over all slots of the ring. The sequence
+ *  number is written last, so a record torn by power loss is never
+ *  taken as the most recent one.
+ * @param rec
+ *  record to be stored, its sequence number is ignored.
+ */
+void ee_storeJournal(const ee_journal_t *rec)
+{
+    ee_journal_t *const journal =
+            (ee_journal_t *) (EEPROM_BASE_ADDR + EEPROM_JOURNAL_OFFSET);
+    uint8_t seq = journal[journalSlot].seq + 1;
+
+    journalSlot = (journalSlot + 1) % SZ_JOURNAL;
+
+    ee_unlock();
+
+    if (journal[journalSlot].minutes != rec->minutes) {
+        journal[journalSlot].minutes = rec->minutes;
+    }
+    if (journal[journalSlot].flags != rec->flags) {
+        journal[journalSlot].flags = rec->flags;
+    }
+    journal[journalSlot].seq = seq;
+
+    ee_lock();
+}
+
+
+/**
+ * @brief Finds the most recent record of the journal ring in EEPROM.
+ *  Records are numbered consecutively, so the most recent one is
+ *  followed by a record which sequence number breaks the order.
+ *  Must be called once before any record is appended.
+ * @param rec
+ *  the place to copy the most recent record to.
+ * @return true if the journal ring holds any record.
+ */
+bool ee_loadJournal(ee_journal_t *rec)
+{
+    uint8_t i, next;
+    const ee_journal_t *const journal =
+        (const ee_journal_t *) (EEPROM_BASE_ADDR + EEPROM_JOURNAL_OFFSET);
+
+    for (i = 0; i < SZ_JOURNAL - 1; i++) {
+        if ( (uint8_t) (journal[i].seq + 1) != journal[i + 1].seq) {
+            break;
+        }
+    }
+
+    next = (i + 1) % SZ_JOURNAL;
+    journalSlot = i;
+    *rec = journal[i];
+
+    // The erased ring holds no records at all.
+    return journal[i].seq != journal[next].seq;
+}
+
 #if 0
 /**
  * @brief Write single value to persistent storage
@@ -0,0 +1,150 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Profiler of interrupt handlers, enabled by CONFIG_ENABLE_PROFILER.
+ * The TIM2 is used as a free-running counter at 1MHz. Entry and exit of
+ * the handlers are time-stamped and min/avg/max of the duration is kept
+ * per handler in microseconds. The display schedules its blanking with
+ * the compare of the same counter and configures TIM2 the same way.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "profile.h"
+#include "display.h"
+#include "stm8s003/timer.h"
+
+#ifdef CONFIG_ENABLE_PROFILER
+
+// Average is calculated with 1/16 timeconstant
+#define PROFILE_AVG_TIMECONSTANT    4
+#define PROFILE_DISPLAY_MAX         999
+
+static struct {
+    uint16_t start;
+    uint16_t min;
+    uint16_t max;
+    uint16_t avg;   // scaled by 2^PROFILE_AVG_TIMECONSTANT
+} stats[PROFILE_HANDLERS];
+
+static uint8_t item;
+
+/**
+ * @brief Gets value of the free-running counter.
+ *  The high byte must be read first to latch the low byte.
+ */
+static uint16_t getCounter()
+{
+    uint16_t t = (uint16_t) TIM2_CNTRH << 8;
+
+    return t | TIM2_CNTRL;
+}
+
+/**
+ * @brief Start TIM2 as a free-running counter and reset statistics.
+ */
+void initProfiler()
+{
+    uint8_t i;
+
+    TIM2_PSCR = 0x04;   // CLK / 16 = 1MHz
+    TIM2_ARRH = 0xFF;
+    TIM2_ARRL = 0xFF;
+    TIM2_CR1 = TIM_CR1_CEN;
+
+    for (i = 0; i < PROFILE_HANDLERS; i++) {
+        stats[i].min = 0xFFFF;
+        stats[i].max = 0;
+        stats[i].avg = 0;
+    }
+    item = 0;
+}
+
+/**
+ * @brief Time-stamps the entry of the interrupt handler.
+ * @param id - PROFILE_TIM4, PROFILE_ADC or PROFILE_EXTI.
+ */
+void profileEnter (uint8_t id)
+{
+    stats[id].start = getCounter();
+}
+
+/**
+ * @brief Time-stamps the exit of the interrupt handler and updates
+ *  the statistics.
+ * @param id - PROFILE_TIM4, PROFILE_ADC or PROFILE_EXTI.
+ */
+void profileExit (uint8_t id)
+{
+    uint16_t d = getCounter() - stats[id].start;
+
+    if (d < stats[id].min) stats[id].min = d;
+    if (d > stats[id].max) stats[id].max = d;
+
+    stats[id].avg += d - (stats[id].avg >> PROFILE_AVG_TIMECONSTANT);
+}
+
+/**
+ * @brief Selects next or previous statistics item to be shown.
+ * @param next - true for next, false for previous item.
+ */
+void selectProfileItem (bool next)
+{
+    if (next) {
+        if (++item >= PROFILE_ITEMS) item = 0;
+    } else {
+        if (item == 0) item = PROFILE_ITEMS;
+        item--;
+    }
+}
+
+/**
+ * @brief Constructs string that represents the selected statistics item.
+ * @param strBuff
+ *  A pointer to a string buffer where the result should be placed.
+ * @param label
+ *  true - the name of item, e.g. "tH" for maximum of TIM4 handler.
+ *  false - the value in microseconds.
+ */
+void profileItemToString (char *strBuff, bool label)
+{
+    static const char handlerName[] = "tAE";
+    static const char statName[] = "L-H";
+    uint8_t id = item / 3, stat = item % 3;
+    uint16_t v;
+
+    if (label) {
+        strBuff[0] = handlerName[id];
+        strBuff[1] = statName[stat];
+        strBuff[2] = 0;
+        return;
+    }
+
+    v = (stat == PROFILE_MIN)? stats[id].min:
+        (stat == PROFILE_MAX)? stats[id].max:
+        stats[id].avg >> PROFILE_AVG_TIMECONSTANT;
+
+    if (v > PROFILE_DISPLAY_MAX) {
+        v = PROFILE_DISPLAY_MAX;
+    }
+
+    itofpa (v, strBuff, 6);
+}
+
+#endif
@@ -24,11 +24,36 @@
 #include "adc.h"
 #include "timer.h"
 #include "params.h"
+#include "menu.h"
 
 #define RELAY_PORT              PA_ODR
 #define RELAY_BIT               0x08
 #define RELAY_TIMER_MULTIPLIER  7
 
+// PID output is time-proportioned over a window of PID_WINDOW relay
+// refreshes (64 * 256 ticks = ~32s). The controller is computed once
+// per window with the output scaled by 2^PID_SHIFT.
+#define PID_WINDOW              64
+#define PID_SHIFT               6
+#define PID_OUTPUT_MAX          ( (int16_t) PID_WINDOW << PID_SHIFT)
+
+// Relay-feedback autotune: number of skipped cycles (the one up to the
+// first switch on and the first full oscillation, which holds the warm-up),
+// number of measured oscillation cycles and Ziegler-Nichols proportional
+// gain Kp = 0.6 * Ku, Ku = 4 * (PID_OUTPUT_MAX / 2) / (pi * (peak-to-peak / 2))
+#define AUTOTUNE_SKIPPED        2
+#define AUTOTUNE_CYCLES         4
+#define AUTOTUNE_KP_PP          3129 // 2.4 * PID_OUTPUT_MAX / pi
+#define AUTOTUNE_GAIN_MAX       9999
+
+// The overshoot is measured when the temperature turns back by the margin
+// from its peak after the relay is switched off.
+#define OVERSHOOT_MARGIN        2
+#define OVERSHOOT_MAX           100
+// The learned overshoot is stored in EEPROM only when it moves away from
+// the stored value by more than this, in 0.1C.
+#define OVERSHOOT_STORE_DELTA   3
+
 #ifdef CONFIG_USE_RELAY_BUZZ
 #define RELAY_BUZZ_OFF_PULSES   6000
 #define RELAY_PRE_BUZZ_PULSES   10
@@ -37,9 +62,36 @@
 static uin16_t pulses;
 #endif
 
+/* Control descriptor, rebuilt by updateRelayControl() when any
+ * of the related parameters is changed. */
+static struct {
+    int16_t upper;      // switching point over the threshold
+    int16_t lower;      // switching point below the threshold
+    uint16_t delay;     // in relay refreshes
+    bool mode;          // relay state over the threshold
+    bool pid;           // PID control instead of hysteresis
+} control;
+
 static uint16_t timer;
 static bool state;
 static bool relayEnable;
+static volatile bool tripped;
+
+static bool pidRunning;
+static uint8_t pidPhase;
+static uint8_t pidOnTime;
+static int32_t pidIntegral;
+static int16_t pidLastTemp;
+
+static bool overshootLearning;
+static int16_t overshootCut, overshootPeak, overshootStored;
+
+static uint8_t tuneCycle;
+static bool tuneOn;
+static uint16_t tuneTime;
+static int16_t tuneMax, tuneMin;
+static uint32_t tunePeriod;
+static uint16_t tuneAmplitude;
 
 /**
  * @brief Configure appropriate bits for GPIO port A, reset local timer
@@ -52,20 +104,56 @@ void initRelay()
     timer = 0;
     state = false;
     relayEnable = true;
+    tripped = false;
+    pidRunning = false;
+    overshootLearning = false;
+    overshootStored = getParamById (PARAM_OVERSHOOT);
+    tuneCycle = AUTOTUNE_OFF;
+}
+
+/**
+ * @brief Rebuilds the control descriptor from parameters. Must be called
+ *  when any of the related parameters is changed.
+ */
+void updateRelayControl()
+{
+    int16_t threshold = getParamById (PARAM_THRESHOLD);
+    int16_t hysteresis = getParamById (PARAM_RELAY_HYSTERESIS) >> 3;
+    int16_t overshoot = getParamById (PARAM_OVERSHOOT);
+
+    control.mode = getParamById (PARAM_RELAY_MODE);
+    control.pid = getParamById (PARAM_PID_MODE);
+    control.delay = getParamById (PARAM_RELAY_DELAY) << RELAY_TIMER_MULTIPLIER;
+    control.upper = threshold + hysteresis;
+    control.lower = threshold - hysteresis;
+
+    // Switch off the relay earlier by the learned overshoot, so the peak
+    // of temperature reaches the switching point.
+    if (control.mode) {
+        control.lower += overshoot;
+        if (control.lower >= control.upper) control.lower = control.upper - 1;
+    } else {
+        control.upper -= overshoot;
+        if (control.upper <= control.lower) control.upper = control.lower + 1;
+    }
 }
 
 /**
- * @brief Sets state of the relay.
+ * @brief Sets state of the relay. The relay is never switched on while
+ *  it is tripped, so the main loop cannot override a trip made by the
+ *  ADC watchdog's interrupt.
  * @param on - true, off - false
  */
 static void setRelay (bool on)
 {
-    if (on) {
+    if (on && !tripped) {
         RELAY_PORT |= RELAY_BIT;
-    } else {
-        RELAY_PORT &= ~RELAY_BIT;
     }
 
+    // Checked again after the write in case the trip happened in between.
+    if (!on || tripped) {
+        RELAY_PORT &= ~RELAY_BIT;
+    }
 }
 
 /**
@@ -82,12 +170,12 @@ static void switchRelay ()
 void buzzRelay ()
 {
 #ifdef CONFIG_USE_RELAY_BUZZ
-    if (!isRelayEnabled() ) {
+    if (!isRelayEnabled() && !tripped) {
         pulses++;
 
         if (pulses > (RELAY_BUZZ_OFF_PULSES + RELAY_PRE_BUZZ_PULSES + RELAY_BUZZ_ON_PULSES) ) {
             pulses = 0;
-            setRelay (getParamById (PARAM_RELAY_MODE) );
+            setRelay (control.mode);
             return;
         }
 
@@ -123,26 +211,298 @@ bool isRelayEnabled()
 }
 
 /**
- * @brief This function is being called during timer's interrupt
- *  request so keep it extremely small and fast.
+ * @brief Switches the relay off immediately and keeps it off until
+ *  resetRelayTrip() is called. Used by the ADC analog watchdog.
+ */
+void tripRelay()
+{
+    if (!tripped) {
+        postMenuEvent (MENU_EVENT_ALARM);
+    }
+
+    tripped = true;
+    setRelay (false);
+}
+
+/**
+ * @brief Resumes the normal relay functionality after a trip.
+ */
+void resetRelayTrip()
+{
+    tripped = false;
+}
+
+/**
+ * @brief Checks if the relay is tripped by the out-of-range temperature.
+ * @return true - tripped.
+ */
+bool isRelayTripped()
+{
+    return tripped;
+}
+
+/**
+ * @brief Calculates the on-time of the relay for the next window using
+ *  fixed-point PID with derivative on measurement. The integral term is
+ *  limited to the output range and frozen while the output is saturated
+ *  in the direction of the error (anti-windup).
+ * @param cooling - true when relay is ON over the threshold.
+ */
+static void updatePid (bool cooling)
+{
+    int16_t temp = getTemperature();
+    int16_t error = getParamById (PARAM_THRESHOLD) - temp;
+    int16_t delta = temp - pidLastTemp;
+    int32_t out;
+
+    // Bumpless start
+    if (!pidRunning) {
+        pidRunning = true;
+        pidIntegral = 0;
+        delta = 0;
+    }
+
+    if (cooling) {
+        error = -error;
+        delta = -delta;
+    }
+
+    pidLastTemp = temp;
+
+    out = (int32_t) getParamById (PARAM_PID_KP) * error + pidIntegral
+          - (int32_t) getParamById (PARAM_PID_KD) * delta;
+
+    if ( (out < PID_OUTPUT_MAX || error < 0) && (out > 0 || error > 0) ) {
+        pidIntegral += (int32_t) getParamById (PARAM_PID_KI) * error;
+
+        if (pidIntegral > PID_OUTPUT_MAX) pidIntegral = PID_OUTPUT_MAX;
+        if (pidIntegral < 0) pidIntegral = 0;
+    }
+
+    if (out > PID_OUTPUT_MAX) out = PID_OUTPUT_MAX;
+    if (out < 0) out = 0;
+
+    pidOnTime = (uint8_t) ( (uint16_t) out >> PID_SHIFT);
+}
+
+/**
+ * @brief Starts measuring of the overshoot when the relay stops driving
+ *  the temperature towards the threshold.
+ * @param temp - temperature when the relay is switched off.
+ */
+static void startOvershoot (int16_t temp)
+{
+    overshootLearning = true;
+    overshootCut = temp;
+    overshootPeak = 0;
+}
+
+/**
+ * @brief Completes measuring of the overshoot and updates the learned
+ *  value using moving average by 1/4. The learned value is stored in
+ *  EEPROM only when it differs from the stored one by more than
+ *  OVERSHOOT_STORE_DELTA, the small corrections of every heating cycle
+ *  would wear the EEPROM out during a long fermentation.
+ */
+static void stopOvershoot()
+{
+    int16_t learned = getParamById (PARAM_OVERSHOOT);
+    int16_t peak = (overshootPeak > OVERSHOOT_MAX)? OVERSHOOT_MAX: overshootPeak;
+
+    overshootLearning = false;
+    learned += (peak - learned) / 4;
+
+    if (learned != getParamById (PARAM_OVERSHOOT) ) {
+        setParamById (PARAM_OVERSHOOT, learned);
+
+        if (learned > overshootStored + OVERSHOOT_STORE_DELTA ||
+                learned < overshootStored - OVERSHOOT_STORE_DELTA) {
+            overshootStored = learned;
+            storeParams();
+        }
+    }
+}
+
+/**
+ * @brief Tracks the peak of temperature after the relay is switched off.
+ * @param cooling - true when relay is ON over the threshold.
+ * @param temp - current temperature.
+ */
+static void learnOvershoot (bool cooling, int16_t temp)
+{
+    int16_t excursion = cooling? overshootCut - temp: temp - overshootCut;
+
+    if (excursion > overshootPeak) {
+        overshootPeak = excursion;
+    } else if (excursion < overshootPeak - OVERSHOOT_MARGIN) {
+        stopOvershoot();
+    }
+}
+
+/**
+ * @brief Starts relay-feedback (Astrom-Hagglund) autotune of PID gains
+ *  around the threshold value.
+ */
+void startAutotune()
+{
+    tuneCycle = 1;
+    tuneOn = false;
+    tuneTime = 0;
+    tunePeriod = 0;
+    tuneAmplitude = 0;
+    tuneMax = tuneMin = getTemperature();
+    pidRunning = false;
+}
+
+/**
+ * @brief Stops autotune, the gains are not changed unless it is done.
+ */
+void stopAutotune()
+{
+    tuneCycle = AUTOTUNE_OFF;
+}
+
+/**
+ * @brief Gets the state of autotune.
+ * @return AUTOTUNE_OFF, AUTOTUNE_DONE or number of the current cycle.
+ */
+uint8_t getAutotuneState()
+{
+    return tuneCycle;
+}
+
+/**
+ * @brief Calculates PID gains using Ziegler-Nichols rules from the
+ *  averaged ultimate period and peak-to-peak amplitude of the oscillation.
+ *  Ti = Tu / 2, Td = Tu / 8, the integral and derivative terms are
+ *  calculated once per PID_WINDOW.
+ */
+static void setAutotuneGains()
+{
+    uint16_t period = tunePeriod / AUTOTUNE_CYCLES;
+    uint16_t amplitude = tuneAmplitude / AUTOTUNE_CYCLES;
+    uint32_t kp, ki, kd;
+
+    if (amplitude == 0) amplitude = 1;
+    if (period == 0) period = 1;
+
+    kp = AUTOTUNE_KP_PP / amplitude;
+    ki = kp * (PID_WINDOW * 2) / period;
+    kd = kp * period / (PID_WINDOW * 8);
+
+    setParamById (PARAM_PID_KP, kp);
+    setParamById (PARAM_PID_KI, ki > AUTOTUNE_GAIN_MAX? AUTOTUNE_GAIN_MAX: ki);
+    setParamById (PARAM_PID_KD, kd > AUTOTUNE_GAIN_MAX? AUTOTUNE_GAIN_MAX: kd);
+}
+
+/**
+ * @brief Relay oscillation around the threshold with the hysteresis
+ *  band. Every cycle starts when the relay is switched on. The cycle up
+ *  to the first switch on and the first full oscillation are skipped
+ *  because they hold the warm-up, the next AUTOTUNE_CYCLES are measured.
+ * @param cooling - true when relay is ON over the threshold.
+ */
+static void refreshAutotune (bool cooling)
+{
+    int16_t temp = getTemperature();
+    int16_t error = getParamById (PARAM_THRESHOLD) - temp;
+    int16_t band = getParamById (PARAM_RELAY_HYSTERESIS) >> 3;
+
+    if (cooling) {
+        error = -error;
+    }
+
+    // Give up when the oscillation is not happening.
+    if (++tuneTime == 0) {
+        tuneCycle = AUTOTUNE_OFF;
+        setRelay (false);
+        return;
+    }
+
+    if (temp > tuneMax) tuneMax = temp;
+    if (temp < tuneMin) tuneMin = temp;
+
+    if (!tuneOn && error > band) {
+        tuneOn = true;
+
+        if (tuneCycle > AUTOTUNE_SKIPPED) {
+            tunePeriod += tuneTime;
+            tuneAmplitude += tuneMax - tuneMin;
+        }
+
+        if (tuneCycle == AUTOTUNE_SKIPPED + AUTOTUNE_CYCLES) {
+            setAutotuneGains();
+            tuneCycle = AUTOTUNE_DONE;
+            return;
+        }
+
+        tuneCycle++;
+        tuneTime = 0;
+        tuneMax = tuneMin = temp;
+    } else if (tuneOn && error < -band) {
+        tuneOn = false;
+    }
+
+    setRelay (tuneOn);
+}
+
+/**
+ * @brief This function is being called from the main loop on every
+ *  TIMER_TASK_RELAY posted by the timer's interrupt.
  */
 void refreshRelay()
 {
-    bool mode = getParamById (PARAM_RELAY_MODE);
+    bool mode = control.mode;
+    int16_t temp;
+
+    if (tripped) {
+        setRelay (false);
+        return;
+    }
 
     if (!isRelayEnabled() ) {
         setRelay (mode);
+        pidRunning = false;
+        overshootLearning = false;
         return;
     }
 
-    if (state) { // Relay state is enabled
-        if (getTemperature() < (getParamById (PARAM_THRESHOLD)
-                                - (getParamById (PARAM_RELAY_HYSTERESIS) >> 3) ) ) {
-            timer++;
+    if (tuneCycle != AUTOTUNE_OFF && tuneCycle != AUTOTUNE_DONE) {
+        refreshAutotune (mode);
+        return;
+    }
+
+    if (control.pid) {
+        overshootLearning = false;
 
-            if ( (getParamById (PARAM_RELAY_DELAY) << RELAY_TIMER_MULTIPLIER) < timer) {
+        if (!pidRunning || pidPhase == 0) {
+            pidPhase = 0;
+            updatePid (mode);
+        }
+
+        setRelay (pidPhase < pidOnTime);
+        pidPhase = (pidPhase + 1) & (PID_WINDOW - 1);
+        return;
+    }
+
+    pidRunning = false;
+    temp = getTemperature();
+
+    if (overshootLearning) {
+        learnOvershoot (mode, temp);
+    }
+
+    if (state) { // Relay state is enabled
+        if (temp < control.lower) {
+            if (++timer > control.delay) {
                 state = false;
                 setRelay (!mode);
+
+                if (mode) {
+                    startOvershoot (temp);
+                } else if (overshootLearning) {
+                    stopOvershoot();
+                }
             } else {
                 setRelay (mode);
             }
@@ -151,13 +511,16 @@ void refreshRelay()
             setRelay (mode);
         }
     } else { // Relay state is disabled
-        if (getTemperature() > (getParamById (PARAM_THRESHOLD)
-                                + (getParamById (PARAM_RELAY_HYSTERESIS) >> 3) ) ) {
-            timer++;
-
-            if ( (getParamById (PARAM_RELAY_DELAY) << RELAY_TIMER_MULTIPLIER) < timer) {
+        if (temp > control.upper) {
+            if (++timer > control.delay) {
                 state = true;
                 setRelay (mode);
+
+                if (!mode) {
+                    startOvershoot (temp);
+                } else if (overshootLearning) {
+                    stopOvershoot();
+                }
             } else {
                 setRelay (!mode);
             }
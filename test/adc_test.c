@@ -0,0 +1,153 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host test of the ADC filter. Bursts of synthetic convertions with a
+ * temperature step and noise go through the ADC interrupt handler, the
+ * filter must settle fast, average the noise out and reject single spikes.
+ */
+
+#include <stdlib.h>
+#include "test.h"
+#include "params_stub.h"
+#include "stm8s003/adc.h"
+
+#undef ADC_DBxR
+#undef ADC_CSR
+#undef ADC_CR1
+#undef ADC_CR3
+#undef ADC_HTRH
+#undef ADC_HTRL
+#undef ADC_LTRH
+#undef ADC_LTRL
+#undef ADC_AWSRH
+#undef ADC_AWSRL
+#undef ADC_AWCRH
+#undef ADC_AWCRL
+static unsigned char ADC_DBxR[0x14];
+static unsigned char ADC_CSR, ADC_CR1, ADC_CR3, ADC_HTRH, ADC_HTRL, ADC_LTRH,
+       ADC_LTRL, ADC_AWSRH, ADC_AWSRL, ADC_AWCRH, ADC_AWCRL;
+
+#include "adc.c"
+
+// Noise of a single convertion, +/- LSB of 10 bit result
+#define NOISE_LSB           3
+// Bursts to settle within the noise level after a large step
+#define SETTLE_BURSTS       10
+// Bursts of the steady input the noise floor is measured on
+#define NOISE_BURSTS        1000
+
+void tripRelay()
+{
+}
+
+/**
+ * @brief Runs the interrupt handler on a burst of convertions.
+ * @param value - 10 bit ADC value of the input.
+ * @param noise - amplitude of the uniform noise added to each convertion.
+ * @return the filter's input for this burst, before the median.
+ */
+static uint16_t burst (uint16_t value, uint8_t noise)
+{
+    uint8_t i;
+    int v;
+
+    for (i = 0; i < ADC_BURST_LENGTH; i++) {
+        v = value + (noise? rand() % (2 * noise + 1) - noise: 0);
+        ADC_DBxR[2 * i] = (unsigned char) (v >> 2);
+        ADC_DBxR[2 * i + 1] = (unsigned char) (v & 0x03);
+    }
+
+    ADC_CSR = 0x80;     // EOC
+    ADC1_EOC_handler();
+    return history[1];
+}
+
+/**
+ * @brief Converts a temperature to the 10 bit input of the ADC.
+ */
+static uint16_t input (int temp)
+{
+    return getAdcCount (temp) >> (RAWTEMP_TABLEBITS - 10);
+}
+
+int main()
+{
+    uint16_t i, settled, target;
+    long raw, filt, rawSq = 0, filtSq = 0;
+
+    srand (1);
+    initADC();
+    burst (input (250), 0);
+    CHECK (getTemperature() >= 248 && getTemperature() <= 252);
+
+    // A single spike is discarded by the median, two in a row are not.
+    target = filtered;
+    burst (input (900), 0);
+    CHECK (filtered == target);
+    burst (input (250), 0);
+    CHECK (filtered == target);
+    burst (input (250), 0);
+    CHECK (filtered == target);
+    burst (input (400), 0);
+    CHECK (filtered == target);
+    burst (input (400), 0);
+    CHECK (filtered != target);
+
+    // Step response: settles within the noise level without overshoot.
+    for (i = 0; i < 50; i++) {
+        burst (input (250), 0);
+    }
+    target = input (400) << 6;
+    settled = 0;
+
+    for (i = 1; i <= 50; i++) {
+        burst (input (400), 0);
+        CHECK (filtered >= target);
+
+        if (!settled && filtered - target < ADC_FILTER_NOISE) {
+            settled = i;
+        }
+    }
+
+    if (!settled || settled > SETTLE_BURSTS) {
+        printf ("settled after %u bursts\n", settled);
+    }
+    CHECK (settled && settled <= SETTLE_BURSTS);
+    CHECK (getTemperature() >= 398 && getTemperature() <= 402);
+
+    // Noise floor: the filter output varies far less than its input.
+    for (i = 0; i < 50; i++) {
+        burst (input (400), NOISE_LSB);
+    }
+
+    for (i = 0; i < NOISE_BURSTS; i++) {
+        raw = (long) burst (input (400), NOISE_LSB) - target;
+        filt = (long) filtered - target;
+        rawSq += raw * raw;
+        filtSq += filt * filt;
+        CHECK (labs (filt) < ADC_FILTER_NOISE);
+    }
+
+    if (filtSq * 8 > rawSq) {
+        printf ("noise power in %ld, out %ld\n", rawSq / NOISE_BURSTS,
+                filtSq / NOISE_BURSTS);
+    }
+    CHECK (filtSq * 8 <= rawSq);
+
+    return TEST_RESULT();
+}
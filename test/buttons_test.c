@@ -0,0 +1,279 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host test of the buttons. The key presses are replayed as timelines of
+ * pin edges with 1ms resolution, the events are handled by a menu stub
+ * which edits a value the way the parameter menu does.
+ */
+
+#include "test.h"
+#include "stm8s003/gpio.h"
+#include "stm8s003/timer.h"
+
+#undef PC_IDR
+#undef PC_CR1
+#undef PC_CR2
+#undef EXTI_CR1
+#undef TIM1_PSCRH
+#undef TIM1_PSCRL
+#undef TIM1_ARRH
+#undef TIM1_ARRL
+#undef TIM1_CR1
+#undef TIM1_EGR
+#undef TIM1_IER
+#undef TIM1_CNTRH
+#undef TIM1_CNTRL
+#undef TIM1_SR1
+static unsigned char PC_IDR = 0xFF, PC_CR1, PC_CR2, EXTI_CR1;
+static unsigned char TIM1_PSCRH, TIM1_PSCRL, TIM1_ARRH, TIM1_ARRL, TIM1_CR1;
+static unsigned char TIM1_EGR, TIM1_IER, TIM1_CNTRH, TIM1_CNTRL, TIM1_SR1;
+
+#include "buttons.c"
+
+#define REFRESH_MS      32  // refreshButtons() is called every 16 ticks
+#define AUTOINC_DELAY   8   // MENU_AUTOINC_DELAY of the menu
+#define MAX_PUSHES      64
+
+static uint32_t now, pressTime;
+static uint16_t value;
+static uint8_t pushes, releases, otherPushes;
+static uint32_t pushTime[MAX_PUSHES];
+static uint8_t pushMultiplier[MAX_PUSHES];
+
+/**
+ * @brief Menu stub, a PUSH of key 2 increments the value by the step
+ *  multiplier and requests the repeat like the parameter menu does.
+ */
+void postMenuEvent (uint8_t event)
+{
+    if (event == MENU_EVENT_PUSH_BUTTON2) {
+        if (pushes < MAX_PUSHES) {
+            pushTime[pushes] = now;
+            pushMultiplier[pushes] = getButtonMultiplier();
+            pushes++;
+        }
+        value += getButtonMultiplier();
+        buttonRetrigger (BUTTON2_BIT, AUTOINC_DELAY);
+    } else if (event == MENU_EVENT_RELEASE_BUTTON2) {
+        releases++;
+    } else if (event == MENU_EVENT_PUSH_BUTTON3) {
+        otherPushes++;
+    }
+}
+
+static void resetEvents()
+{
+    pushes = releases = otherPushes = 0;
+    value = 0;
+}
+
+/**
+ * @brief Sets the level of the key's pin, the falling edge raises EXTI2
+ *  when the interrupt of the pin is enabled.
+ */
+static void setKey (uint8_t bit, bool pressed)
+{
+    bool edge = pressed && (PC_IDR & bit) && (PC_CR2 & bit);
+
+    if (pressed) {
+        PC_IDR &= ~bit;
+    } else {
+        PC_IDR |= bit;
+    }
+
+    if (edge) {
+        EXTI2_handler();
+    }
+}
+
+/**
+ * @brief Runs the TIM1 one-shot timer and the timer's tick for a while.
+ */
+static void run (uint32_t ms)
+{
+    for (; ms > 0; ms--) {
+        now++;
+
+        if ( (TIM1_CR1 & TIM_CR1_CEN) && ++TIM1_CNTRL > TIM1_ARRL) {
+            TIM1_CR1 &= ~TIM_CR1_CEN;
+            TIM1_UPD_handler();
+        }
+
+        if (now % REFRESH_MS == 0) {
+            refreshButtons();
+        }
+    }
+}
+
+/**
+ * @brief Holds key 2 until the value reaches the target.
+ * @return time of holding in ms.
+ */
+static uint32_t holdUntil (uint16_t target)
+{
+    uint32_t held;
+
+    resetEvents();
+    pressTime = now;
+    setKey (BUTTON2_BIT, true);
+
+    while (value < target && now - pressTime < 10000) {
+        run (1);
+    }
+
+    setKey (BUTTON2_BIT, false);
+    held = now - pressTime;
+    run (200);
+
+    return held;
+}
+
+/**
+ * @brief Runs until the next refresh is the given time ahead.
+ */
+static void alignToRefresh (uint32_t ahead)
+{
+    while ( (now + ahead) % REFRESH_MS != 0) {
+        run (1);
+    }
+}
+
+/**
+ * @brief Changes the level of the key's pin with contact bounce: the pin
+ *  toggles every millisecond before it settles.
+ */
+static void bounceKey (uint8_t bit, bool pressed)
+{
+    uint8_t i;
+
+    for (i = 0; i < 4; i++) {
+        setKey (bit, (i & 1)? !pressed: pressed);
+        run (1);
+    }
+    setKey (bit, pressed);
+}
+
+/**
+ * @brief Presses key 2 for the given time with contact bounce on both
+ *  edges, the refresh comes the given time after the release starts.
+ */
+static void tapKey (uint32_t ms, uint32_t refresh)
+{
+    resetEvents();
+    pressTime = now;
+    bounceKey (BUTTON2_BIT, true);
+    run (ms);
+    alignToRefresh (refresh);
+    bounceKey (BUTTON2_BIT, false);
+    run (200);
+}
+
+int main()
+{
+    uint8_t i;
+    uint32_t held;
+
+    initButtons();
+    PC_CR2 = BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT;
+    run (100);
+
+    // Full-range edits in under 2 seconds: P2 (300..700, step 10) and
+    // P1 (1..150).
+    CHECK (holdUntil (40) < 2000);
+    CHECK (holdUntil (149) < 2000);
+
+    // P9 (-99..99)
+    held = holdUntil (198);
+    if (held >= 2000) {
+        printf ("198 steps in %u ms, %u pushes\n", (unsigned) held, pushes);
+    }
+    CHECK (held < 2000);
+    CHECK (releases == 1);
+
+    // The first PUSH comes after the debounce time, the first repeat
+    // BUTTON_T_REPEAT - 1 refreshes after the first one past the press.
+    CHECK (pushTime[0] - pressTime == BUTTON_DEBOUNCE_MS + 1);
+    CHECK (pushTime[1] - pressTime > (BUTTON_T_REPEAT - 1) * REFRESH_MS);
+    CHECK (pushTime[1] - pressTime <= BUTTON_T_REPEAT * REFRESH_MS);
+
+    for (i = 1; i < pushes; i++) {
+        // The repeat interval never gets shorter than a refresh.
+        CHECK (pushTime[i] - pushTime[i - 1] >= REFRESH_MS);
+        // The step stays 1 for the first press and BUTTON_ACCEL_REPEATS - 1
+        // repeats, then it doubles every four repeats up to the maximum.
+        if (i < BUTTON_ACCEL_REPEATS) {
+            CHECK (pushMultiplier[i] == 1);
+        } else {
+            CHECK (pushMultiplier[i] >= pushMultiplier[i - 1]);
+            CHECK (pushMultiplier[i] <= BUTTON_MAX_MULTIPLIER);
+        }
+    }
+    CHECK (pushMultiplier[0] == 1);
+    CHECK (pushMultiplier[BUTTON_ACCEL_REPEATS] == 2);
+    CHECK (pushMultiplier[pushes - 1] == BUTTON_MAX_MULTIPLIER);
+
+    // A single press changes the value by one step and a fresh press
+    // starts over without the acceleration.
+    holdUntil (1);
+    CHECK (pushes == 1);
+    CHECK (value == 1);
+    CHECK (pushMultiplier[0] == 1);
+
+    // A bouncing press sends one PUSH within the debounce time and one
+    // RELEASE, no matter where the edges fall in between two refreshes
+    // and even when a refresh sees the release bouncing.
+    for (i = 0; i < REFRESH_MS; i++) {
+        run (1);
+        tapKey (300, 1 + i % 4);
+        CHECK (pushes == 1);
+        CHECK (releases == 1);
+        CHECK (pushTime[0] - pressTime <= BUTTON_DEBOUNCE_MS + 1);
+    }
+
+    // Keys pressed at once send a PUSH each.
+    resetEvents();
+    setKey (BUTTON2_BIT, true);
+    setKey (BUTTON3_BIT, true);
+    run (100);
+    setKey (BUTTON2_BIT, false);
+    setKey (BUTTON3_BIT, false);
+    run (200);
+    CHECK (pushes == 1);
+    CHECK (otherPushes == 1);
+
+    // A glitch shorter than the debounce time is ignored.
+    resetEvents();
+    setKey (BUTTON2_BIT, true);
+    run (3);
+    setKey (BUTTON2_BIT, false);
+    run (200);
+    CHECK (pushes == 0);
+    CHECK (releases == 0);
+
+    // A long-press enabled key sends one PUSH on release.
+    buttonEnableLongPress (BUTTON2_BIT);
+    for (i = 0; i < REFRESH_MS; i++) {
+        run (1);
+        tapKey (300, 1 + i % 4);
+        CHECK (pushes == 1);
+        CHECK (releases == 0);
+    }
+    buttonEnableLongPress (0);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,160 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host test of the segment font. The glyph of every character code must
+ * be the same as with the character/mask pairs setDigit() used to scan.
+ */
+
+#include "test.h"
+#include "stm8s003/gpio.h"
+#include "stm8s003/timer.h"
+
+#undef PA_ODR
+#undef PA_DDR
+#undef PA_CR1
+#undef PB_ODR
+#undef PB_DDR
+#undef PB_CR1
+#undef PC_ODR
+#undef PC_DDR
+#undef PC_CR1
+#undef PD_ODR
+#undef PD_DDR
+#undef PD_CR1
+#undef TIM2_CR1
+#undef TIM2_IER
+#undef TIM2_SR1
+#undef TIM2_CNTRH
+#undef TIM2_CNTRL
+#undef TIM2_PSCR
+#undef TIM2_ARRH
+#undef TIM2_ARRL
+#undef TIM2_CCR1H
+#undef TIM2_CCR1L
+static unsigned char PA_ODR, PA_DDR, PA_CR1, PB_ODR, PB_DDR, PB_CR1, PC_ODR,
+       PC_DDR, PC_CR1, PD_ODR, PD_DDR, PD_CR1, TIM2_CR1, TIM2_IER, TIM2_SR1,
+       TIM2_CNTRH, TIM2_CNTRL, TIM2_PSCR, TIM2_ARRH, TIM2_ARRL, TIM2_CCR1H,
+       TIM2_CCR1L;
+
+#include "display.c"
+
+/**
+ * @brief The glyphs of the character/mask pairs the font was made of.
+ * @param c - character code.
+ * @return segment mask, blank for characters without a glyph.
+ */
+static uint8_t oldGlyph (uint8_t c)
+{
+    switch (c) {
+    case ' ':
+        return 0;
+    case '-':
+        return bit(SEG_G);
+    case '0':
+        return bit(SEG_B) | bit(SEG_F) | bit(SEG_C) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E);
+    case '1':
+        return bit(SEG_B) | bit(SEG_C);
+    case '2':
+        return bit(SEG_B) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E);
+    case '3':
+        return bit(SEG_B) | bit(SEG_C) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D);
+    case '4':
+        return bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G);
+    case '5':
+        return bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D);
+    case '6':
+        return bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E);
+    case '7':
+        return bit(SEG_B) | bit(SEG_C) | bit(SEG_A);
+    case '8':
+        return bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E);
+    case '9':
+        return bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D);
+    case 'A':
+        return bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_E);
+    case 'B':
+        return bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E);
+    case 'C':
+        return bit(SEG_F) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E);
+    case 'D':
+        return bit(SEG_B) | bit(SEG_C) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E);
+    case 'E':
+        return bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E);
+    case 'F':
+        return bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_E);
+    case 'H':
+        return bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_E);
+    case 'L':
+        return bit(SEG_F) | bit(SEG_D) | bit(SEG_E);
+    case 'N':
+        return bit(SEG_B) | bit(SEG_F) | bit(SEG_C) | bit(SEG_A) | bit(SEG_E);
+    case 'O':
+        return bit(SEG_B) | bit(SEG_F) | bit(SEG_C) | bit(SEG_A) | bit(SEG_D) | bit(SEG_E);
+    case 'P':
+        return bit(SEG_B) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_E);
+    case 'R':
+        return bit(SEG_A) | bit(SEG_E) | bit(SEG_F);
+    case 'S':
+        return bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_A) | bit(SEG_D);
+    case 'T':
+        return bit(SEG_F) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E);
+    case 'c':
+        return bit(SEG_G) | bit(SEG_E) | bit(SEG_D);
+    case 'd':
+        return bit(SEG_B) | bit(SEG_C) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E);
+    case 'h':
+        return bit(SEG_F) | bit(SEG_E) | bit(SEG_G) | bit(SEG_C);
+    case 'o':
+        return bit(SEG_G) | bit(SEG_C) | bit(SEG_D) | bit(SEG_E);
+    case 'n':
+        return bit(SEG_C) | bit(SEG_G) | bit(SEG_E);
+    case 'r':
+        return bit(SEG_G) | bit(SEG_E);
+    case 't':
+        return bit(SEG_F) | bit(SEG_G) | bit(SEG_D) | bit(SEG_E);
+    case 'y':
+        return bit(SEG_B) | bit(SEG_C) | bit(SEG_F) | bit(SEG_G) | bit(SEG_D);
+    default:
+        return 0;
+    }
+}
+
+int main()
+{
+    unsigned c;
+    uint8_t id;
+
+    initDisplay();
+    setDisplayTestMode (false, "");
+
+    for (c = 0; c < 256; c++) {
+        id = c % 3;
+        setDigit (id, (uint8_t) c, false);
+
+        if (glyph[id] != oldGlyph (c) ) {
+            printf ("code %u: glyph %02x, was %02x\n", c, glyph[id],
+                    oldGlyph (c) );
+        }
+        CHECK (glyph[id] == oldGlyph (c) );
+
+        setDigit (id, (uint8_t) c, true);
+        CHECK (glyph[id] == (oldGlyph (c) | bit(SEG_P) ) );
+    }
+
+    return TEST_RESULT();
+}
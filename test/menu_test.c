@@ -0,0 +1,184 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host test of the menu state machine. Every case starts in a state,
+ * feeds an event and checks the state the menu goes to.
+ */
+
+#include "test.h"
+#include "params_stub.h"
+#include "menu.c"
+
+static bool fTimer, beep, relay, displayOff;
+static uint8_t longPress, autotune;
+
+void buttonEnableLongPress (uint8_t keys) { longPress = keys; }
+void buttonRetrigger (uint8_t keys, uint8_t timeout) { (void) keys; (void) timeout; }
+uint8_t getButtonMultiplier() { return 1; }
+bool getButton2() { return false; }
+bool getButton3() { return false; }
+void setDisplayOff (bool val) { displayOff = val; }
+bool isFTimer() { return fTimer; }
+void startFTimer() { fTimer = true; }
+void pauseFTimer (bool pause) { (void) pause; }
+bool isFTimerPaused() { return false; }
+uint16_t getUptimeTicks() { return 0; }
+void enableBeep (uint8_t set) { beep = set; }
+void enableRelay (bool state) { relay = state; }
+bool isRelayEnabled() { return relay; }
+void resetRelayTrip() {}
+void startAutotune() { autotune = 1; }
+void stopAutotune() { autotune = AUTOTUNE_OFF; }
+uint8_t getAutotuneState() { return autotune; }
+
+static const struct {
+    uint8_t state;
+    uint8_t event;
+    bool fTimer;        // fermentation timer is running
+    uint8_t expected;
+} cases[] = {
+    {MENU_ROOT,           MENU_EVENT_PUSH_BUTTON1,      false, MENU_SET_TIMER},
+    {MENU_ROOT,           MENU_EVENT_LONGPRESS_BUTTON1, false, MENU_SELECT_PARAM},
+    {MENU_ROOT,           MENU_EVENT_LONGPRESS_BUTTON2, false, MENU_ROOT},
+    {MENU_ROOT,           MENU_EVENT_LONGPRESS_BUTTON3, false, MENU_TIMER_RUNNING},
+    {MENU_ROOT,           MENU_EVENT_RELEASE_BUTTON1,   false, MENU_ROOT},
+    {MENU_SELECT_PARAM,   MENU_EVENT_PUSH_BUTTON1,      false, MENU_CHANGE_PARAM},
+    {MENU_SELECT_PARAM,   MENU_EVENT_PUSH_BUTTON2,      false, MENU_SELECT_PARAM},
+    {MENU_SELECT_PARAM,   MENU_EVENT_LONGPRESS_BUTTON1, false, MENU_AUTOTUNE},
+    {MENU_CHANGE_PARAM,   MENU_EVENT_PUSH_BUTTON1,      false, MENU_SELECT_PARAM},
+    {MENU_CHANGE_PARAM,   MENU_EVENT_PUSH_BUTTON3,      false, MENU_CHANGE_PARAM},
+    {MENU_SET_TIMER,      MENU_EVENT_PUSH_BUTTON1,      false, MENU_TIMER_RUNNING},
+    {MENU_TIMER_RUNNING,  MENU_EVENT_PUSH_BUTTON1,      true,  MENU_TIMER_RUNNING},
+    {MENU_TIMER_RUNNING,  MENU_EVENT_CHECK_TIMER,       true,  MENU_TIMER_RUNNING},
+    {MENU_TIMER_RUNNING,  MENU_EVENT_CHECK_TIMER,       false, MENU_TIMER_FINISHED},
+    {MENU_TIMER_FINISHED, MENU_EVENT_PUSH_BUTTON2,      false, MENU_ROOT},
+    {MENU_TIMER_FINISHED, MENU_EVENT_CHECK_TIMER,       false, MENU_TIMER_FINISHED},
+    {MENU_ALARM,          MENU_EVENT_PUSH_BUTTON3,      false, MENU_ROOT},
+    {MENU_ALARM,          MENU_EVENT_PUSH_BUTTON3,      true,  MENU_TIMER_RUNNING},
+    {MENU_ALARM,          MENU_EVENT_ALARM,             false, MENU_ALARM},
+    {MENU_AUTOTUNE,       MENU_EVENT_PUSH_BUTTON1,      false, MENU_ROOT},
+    {MENU_INIT,           MENU_EVENT_CHECK_TIMER,       true,  MENU_TIMER_RUNNING},
+    {MENU_INIT,           MENU_EVENT_ALARM,             false, MENU_ALARM},
+    {MENU_SET_TIMER,      MENU_EVENT_ALARM,             false, MENU_ALARM},
+    {MENU_TIMER_RUNNING,  MENU_EVENT_ALARM,             true,  MENU_ALARM},
+};
+
+/**
+ * @brief Puts the menu into the given state without running the entry
+ *  actions.
+ */
+static void enterState (uint8_t state, bool running)
+{
+    initMenu();
+    menuState = state;
+    fTimer = running;
+    autotune = AUTOTUNE_OFF;
+}
+
+int main()
+{
+    uint8_t i, state, event;
+
+    for (i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+        enterState (cases[i].state, cases[i].fTimer);
+        feedMenu (cases[i].event);
+
+        if (getMenuDisplay() != cases[i].expected) {
+            printf ("case %u: state %u, event %u goes to %u\n", i,
+                    cases[i].state, cases[i].event, getMenuDisplay() );
+        }
+        CHECK (getMenuDisplay() == cases[i].expected);
+    }
+
+    // Every event in every state leads to a valid state, out-of-range
+    // events are ignored.
+    for (state = 0; state < MENU_STATES; state++) {
+        for (event = 0; event <= MENU_EVENTS; event++) {
+            enterState (state, false);
+            feedMenu (event);
+            CHECK (getMenuDisplay() < MENU_STATES);
+        }
+    }
+
+    // The entry actions run on a state change only, the timer finishes
+    // after it is started.
+    enterState (MENU_SET_TIMER, false);
+    feedMenu (MENU_EVENT_PUSH_BUTTON1);
+    CHECK (longPress == 0);
+    fTimer = false;
+    feedMenu (MENU_EVENT_CHECK_TIMER);
+    feedMenu (MENU_EVENT_CHECK_TIMER);
+    CHECK (getMenuDisplay() == MENU_TIMER_FINISHED);
+    feedMenu (MENU_EVENT_PUSH_BUTTON1);
+    CHECK (getMenuDisplay() == MENU_ROOT);
+    CHECK (longPress == (BUTTON1_BIT | BUTTON2_BIT | BUTTON3_BIT) );
+
+    // The initial state waits a second, the timeout returns to the root.
+    enterState (MENU_INIT, false);
+    for (i = 0; i < MENU_1_SEC_PASSED; i++) {
+        postMenuEvent (MENU_EVENT_CHECK_TIMER);
+        refreshMenu();
+    }
+    CHECK (getMenuDisplay() == MENU_INIT);
+    postMenuEvent (MENU_EVENT_CHECK_TIMER);
+    refreshMenu();
+    CHECK (getMenuDisplay() == MENU_ROOT);
+
+    enterState (MENU_SELECT_PARAM, false);
+    for (i = 0; i < MENU_5_SEC_PASSED; i++) {
+        postMenuEvent (MENU_EVENT_CHECK_TIMER);
+        refreshMenu();
+    }
+    CHECK (getMenuDisplay() == MENU_SELECT_PARAM);
+    postMenuEvent (MENU_EVENT_CHECK_TIMER);
+    refreshMenu();
+    CHECK (getMenuDisplay() == MENU_ROOT);
+
+    // The queued events are handled in order, the timer's event once.
+    enterState (MENU_ROOT, false);
+    postMenuEvent (MENU_EVENT_PUSH_BUTTON1);
+    postMenuEvent (MENU_EVENT_CHECK_TIMER);
+    postMenuEvent (MENU_EVENT_CHECK_TIMER);
+    postMenuEvent (MENU_EVENT_PUSH_BUTTON1);
+    refreshMenu();
+    CHECK (getMenuDisplay() == MENU_TIMER_RUNNING);
+    CHECK (timer == 0);
+
+    // The timer's event and the alarm get through a queue full of the
+    // button events, and the timer's event keeps coming afterwards.
+    enterState (MENU_ROOT, false);
+    for (i = 0; i < 2 * MENU_QUEUE_SIZE; i++) {
+        postMenuEvent (MENU_EVENT_RELEASE_BUTTON1);
+    }
+    postMenuEvent (MENU_EVENT_CHECK_TIMER);
+    refreshMenu();
+    CHECK (timer == 1);
+    postMenuEvent (MENU_EVENT_CHECK_TIMER);
+    refreshMenu();
+    CHECK (timer == 2);
+
+    for (i = 0; i < 2 * MENU_QUEUE_SIZE; i++) {
+        postMenuEvent (MENU_EVENT_RELEASE_BUTTON1);
+    }
+    postMenuEvent (MENU_EVENT_CHECK_TIMER);
+    postMenuEvent (MENU_EVENT_ALARM);
+    refreshMenu();
+    CHECK (getMenuDisplay() == MENU_ALARM);
+
+    return TEST_RESULT();
+}
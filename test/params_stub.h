@@ -0,0 +1,82 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Parameters stub for the host tests, holds the default values.
+ */
+
+#ifndef PARAMS_STUB_H
+#define PARAMS_STUB_H
+
+#include "params.h"
+
+#define PARAM_DEFAULT(name, _min, _max, _def, ARGS...) _def
+
+static int paramValues[N_PARAMETERS] = {
+    PARAMETERS(PARAM_DEFAULT)
+};
+
+int getParamById (uint8_t id)
+{
+    return paramValues[id];
+}
+
+void setParamById (uint8_t id, int value)
+{
+    paramValues[id] = value;
+}
+
+static int paramsStored;
+
+void storeParams()
+{
+    paramsStored++;
+}
+
+static uint8_t paramId;
+
+void setParamId (uint8_t id)
+{
+    paramId = id;
+}
+
+uint8_t getParamId()
+{
+    return paramId;
+}
+
+void incParamId()
+{
+    paramId++;
+}
+
+void decParamId()
+{
+    paramId--;
+}
+
+void incParam (uint8_t times)
+{
+    paramValues[paramId] += times;
+}
+
+void decParam (uint8_t times)
+{
+    paramValues[paramId] -= times;
+}
+
+#endif
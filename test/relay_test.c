@@ -0,0 +1,197 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host test of the relay. The relay-feedback autotune drives a simulated
+ * first-order plant with dead time, the resulting PID gains must not
+ * depend on the temperature the autotune is started at. The on/off
+ * thermostat on the same plant learns the overshoot and must not store it
+ * in EEPROM on every heating cycle.
+ */
+
+#include <stdlib.h>
+#include "test.h"
+#include "params_stub.h"
+#include "stm8s003/gpio.h"
+
+#undef PA_ODR
+#undef PA_DDR
+#undef PA_CR1
+static unsigned char PA_ODR, PA_DDR, PA_CR1;
+
+#include "relay.c"
+
+// Plant in 0.1 degrees of Celsius, stepped once per relay refresh (~0.5s)
+#define PLANT_AMBIENT       200.0
+#define PLANT_HEATER        500.0
+#define PLANT_TAU           2400.0  // in refreshes
+#define PLANT_DEAD_TIME     120     // in refreshes
+#define PLANT_MAX_STEPS     200000L
+#define AMBIENT_SWING       100.0   // +/- 10C of the room temperature
+#define AMBIENT_PERIOD      40000L  // in refreshes
+
+static double plantTemp;
+
+int getTemperature()
+{
+    return (int) (plantTemp + 0.5);
+}
+
+void postMenuEvent (uint8_t event)
+{
+    (void) event;
+}
+
+/**
+ * @brief Runs autotune on the simulated plant.
+ * @param start - temperature of the plant when autotune is started.
+ * @param gains - the place to copy Kp, Ki and Kd to.
+ * @return true if autotune is done.
+ */
+static bool runAutotune (double start, int *gains)
+{
+    static bool heater[PLANT_DEAD_TIME];
+    long step;
+
+    plantTemp = start;
+    paramValues[PARAM_PID_KP] = paramValues[PARAM_PID_KI] =
+                                    paramValues[PARAM_PID_KD] = 0;
+
+    for (step = 0; step < PLANT_DEAD_TIME; step++) {
+        heater[step] = false;
+    }
+
+    initRelay();
+    updateRelayControl();
+    startAutotune();
+
+    for (step = 0; step < PLANT_MAX_STEPS; step++) {
+        double input = heater[step % PLANT_DEAD_TIME]? PLANT_HEATER: 0;
+
+        plantTemp += (PLANT_AMBIENT + input - plantTemp) / PLANT_TAU;
+
+        refreshRelay();
+        heater[step % PLANT_DEAD_TIME] = (PA_ODR & RELAY_BIT) != 0;
+
+        if (getAutotuneState() == AUTOTUNE_DONE ||
+                getAutotuneState() == AUTOTUNE_OFF) {
+            break;
+        }
+    }
+
+    gains[0] = getParamById (PARAM_PID_KP);
+    gains[1] = getParamById (PARAM_PID_KI);
+    gains[2] = getParamById (PARAM_PID_KD);
+
+    return getAutotuneState() == AUTOTUNE_DONE;
+}
+
+/**
+ * @brief Runs the on/off thermostat on the simulated plant, the relay
+ *  learns the overshoot and the control follows it.
+ * @param steps - number of relay refreshes to run.
+ * @return number of heating cycles.
+ */
+static int runThermostat (long steps)
+{
+    static bool heater[PLANT_DEAD_TIME];
+    bool on = false;
+    int cycles = 0;
+    long step;
+
+    plantTemp = PLANT_AMBIENT;
+    paramValues[PARAM_PID_MODE] = 0;
+    paramValues[PARAM_OVERSHOOT] = 0;
+
+    for (step = 0; step < PLANT_DEAD_TIME; step++) {
+        heater[step] = false;
+    }
+
+    initRelay();
+
+    for (step = 0; step < steps; step++) {
+        double input = heater[step % PLANT_DEAD_TIME]? PLANT_HEATER: 0;
+        // The room temperature drifts, so every cycle overshoots a bit
+        // differently.
+        long phase = step % AMBIENT_PERIOD;
+        double ambient = PLANT_AMBIENT + AMBIENT_SWING *
+                         ( (phase < AMBIENT_PERIOD / 2? phase:
+                            AMBIENT_PERIOD - phase) * 4.0 / AMBIENT_PERIOD - 1);
+
+        plantTemp += (ambient + input - plantTemp) / PLANT_TAU;
+
+        updateRelayControl();
+        refreshRelay();
+
+        if (!on && (PA_ODR & RELAY_BIT) ) {
+            cycles++;
+        }
+        on = (PA_ODR & RELAY_BIT) != 0;
+        heater[step % PLANT_DEAD_TIME] = on;
+    }
+
+    return cycles;
+}
+
+/**
+ * @brief Checks that two gains differ by no more than 10%.
+ */
+static bool similar (int a, int b)
+{
+    return abs (a - b) * 10 <= b;
+}
+
+int main()
+{
+    int cold[3], warm[3], cycles;
+    uint8_t i;
+
+    // Cold start well below the threshold, the warm-up takes much longer
+    // than an oscillation and must not be measured.
+    CHECK (runAutotune (PLANT_AMBIENT, cold) );
+    // Warm start right at the threshold.
+    CHECK (runAutotune (getParamById (PARAM_THRESHOLD), warm) );
+
+    for (i = 0; i < 3; i++) {
+        if (warm[i] <= 0 || !similar (cold[i], warm[i]) ) {
+            printf ("gain %u cold: %d, warm: %d\n", i, cold[i], warm[i]);
+        }
+        CHECK (warm[i] > 0);
+        CHECK (similar (cold[i], warm[i]) );
+    }
+
+    // The overshoot is learned without storing it on every heating cycle.
+    paramsStored = 0;
+    cycles = runThermostat (PLANT_MAX_STEPS);
+    if (paramsStored * 50 > cycles || getParamById (PARAM_OVERSHOOT) <= 0) {
+        printf ("%d heating cycles, overshoot %d stored %d times\n", cycles,
+                getParamById (PARAM_OVERSHOOT), paramsStored);
+    }
+    CHECK (getParamById (PARAM_OVERSHOOT) > 0);
+    CHECK (paramsStored > 0 && paramsStored * 50 <= cycles);
+
+    // The trip from the ADC watchdog cannot be overridden by the main loop.
+    initRelay();
+    tripRelay();
+    setRelay (true);
+    CHECK ( (PA_ODR & RELAY_BIT) == 0);
+    resetRelayTrip();
+    setRelay (true);
+    CHECK ( (PA_ODR & RELAY_BIT) != 0);
+
+    return TEST_RESULT();
+}
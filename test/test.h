@@ -0,0 +1,43 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Minimal support for the host tests. A test includes the module under
+ * test directly, replaces the registers it touches with plain variables
+ * and provides stubs for the functions of other modules.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+/* The profiler hooks are not a subject of the host tests. */
+#undef CONFIG_ENABLE_PROFILER
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond) ) { \
+            printf ("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT()   (failures? 1: 0)
+
+#endif
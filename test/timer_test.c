@@ -0,0 +1,127 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host test of the timebase. The clock trim must hold over a long run
+ * for the whole range of the trim parameter, and the fermentation timer
+ * must be formatted with the symbol of its unit.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "params_stub.h"
+#include "stm8s003/clock.h"
+#include "stm8s003/timer.h"
+
+#undef CLK_CKDIVR
+#undef TIM4_PSCR
+#undef TIM4_ARR
+#undef TIM4_IER
+#undef TIM4_CR1
+#undef TIM4_SR
+static unsigned char CLK_CKDIVR, TIM4_PSCR, TIM4_ARR, TIM4_IER, TIM4_CR1, TIM4_SR;
+
+#include "timer.c"
+
+#define RUN_SECONDS     54000L  // 15 hours
+
+void refreshButtons() {}
+void refreshDisplay() {}
+void displayBeep() {}
+void setDisplayTestMode (bool val, const char *str) { (void) val; (void) str; }
+void postMenuEvent (uint8_t event) { (void) event; }
+void buzzRelay() {}
+void enableRelay (bool state) { (void) state; }
+void ee_storeJournal (const ee_journal_t *rec) { (void) rec; }
+bool ee_loadJournal (ee_journal_t *rec) { (void) rec; return false; }
+
+char *xitoa (int16_t val, char *str, uint8_t len)
+{
+    str += len;
+    *str = 0;
+
+    for (; len > 0; len--) {
+        *--str = '0' + (val % 10);
+        val /= 10;
+    }
+    return str;
+}
+
+/**
+ * @brief Formats the fermentation timer set to the given seconds.
+ */
+static bool timeIs (uint32_t seconds, const char *format, const char *expected)
+{
+    char buffer[8];
+
+    fTimer = seconds;
+    uptimeToString (buffer, format);
+    return strcmp (buffer, expected) == 0;
+}
+
+/**
+ * @brief Counts the ticks of the timer's interrupt over the run.
+ * @param trim - value of the clock trim parameter.
+ * @return difference in ticks from the exactly trimmed run.
+ */
+static long runDrift (int trim)
+{
+    long ticks = 0;
+
+    setParamById (PARAM_CLOCK_TRIM, trim);
+    initTimer();
+
+    // The first second after reset is not trimmed yet.
+    while (getUptime() < 1) {
+        TIM4_UPD_handler();
+    }
+
+    while (getUptime() < RUN_SECONDS + 1) {
+        TIM4_UPD_handler();
+        ticks++;
+    }
+
+    // The exact length of the run is 500 * (1 - trim / 10000) ticks/s.
+    return ticks - (RUN_SECONDS * TICKS_IN_SECOND * (10000 - trim) ) / 10000;
+}
+
+int main()
+{
+    static const int trims[] = {-99, -50, -21, -20, -1, 0, 1, 19, 20, 50, 99};
+    uint8_t i;
+    long drift;
+
+    for (i = 0; i < sizeof trims / sizeof trims[0]; i++) {
+        drift = runDrift (trims[i]);
+
+        // Off by the trim remainder carried over, less than a tick.
+        if (labs (drift) > 1) {
+            printf ("trim %d drifts by %ld ticks in 15 h\n", trims[i], drift);
+        }
+        CHECK (labs (drift) <= 1);
+    }
+
+    // Every unit of the fermentation timer is shown with its own symbol.
+    CHECK (timeIs (45 * SECONDS_IN_HOUR, "TTU", "45h") );
+    CHECK (timeIs (45 * 60L, "TTU", "45n") );
+    CHECK (timeIs (45, "TTU", "45S") );
+    CHECK (timeIs (8 * SECONDS_IN_HOUR + 30 * 60L, "T.tt", "8.30") );
+    CHECK (timeIs (5 * 60L + 42, "TU.", "5n.") );
+
+    return TEST_RESULT();
+}
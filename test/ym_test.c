@@ -0,0 +1,169 @@
+/*
+ * This file is part of the firmware for yogurt maker project
+ * (https://github.com/mister-grumbler/yogurt-maker).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host test of the views. Every menu state is rendered through its entry
+ * of the renderers table, the text must be formatted again only when the
+ * blink phase or the shown value change.
+ */
+
+#include <string.h>
+#include "test.h"
+#include "params_stub.h"
+
+#define main ym_main
+#include "ym.c"
+#undef main
+
+static uint8_t menuState;
+static uint32_t uptime;
+static uint16_t ticks;
+static int temperature;
+static bool relay, beep, paused;
+static uint8_t autotune;
+static char shown[8];
+static int draws;
+
+uint8_t getMenuDisplay() { return menuState; }
+int getTemperature() { return temperature; }
+uint32_t getUptime() { return uptime; }
+uint16_t getUptimeTicks() { return ticks; }
+bool isFTimerPaused() { return paused; }
+bool isRelayEnabled() { return relay; }
+uint8_t getAutotuneState() { return autotune; }
+void enableBeep (uint8_t set) { beep = set; }
+void setDisplayOff (bool val) { (void) val; }
+
+void setDisplayStr (const char *str)
+{
+    strncpy (shown, str, sizeof shown - 1);
+    draws++;
+}
+
+void itofpa (int val, char* str, uint8_t pointPosition)
+{
+    (void) pointPosition;
+    sprintf (str, "%d", val);
+}
+
+void paramToString (uint8_t id, char *str)
+{
+    sprintf (str, "%d", paramValues[id]);
+}
+
+// The format itself is shown, so the choice of format can be checked.
+void uptimeToString (char *str, const char *format)
+{
+    strcpy (str, format);
+}
+
+// Not called, ym_main() needs them to link.
+void initMenu() {}
+void initButtons() {}
+void initParamsEEPROM (bool restore) { (void) restore; }
+void initDisplay() {}
+void initADC() {}
+void initRelay() {}
+void initTimer() {}
+void setDisplayTestMode (bool val, const char *str) { (void) val; (void) str; }
+uint8_t takeTimerTasks() { return 0; }
+void refreshMenu() {}
+void startADC() {}
+void refreshRelay() {}
+void storeFTimer() {}
+bool getButton2() { return false; }
+bool getButton3() { return false; }
+
+/**
+ * @brief Renders the given state at the given time.
+ * @return true if the text has been formatted and shown again.
+ */
+static bool renderAt (uint8_t state, uint32_t seconds, uint16_t tick)
+{
+    int before = draws;
+
+    menuState = state;
+    uptime = seconds;
+    ticks = tick;
+    render (state);
+    return draws != before;
+}
+
+int main()
+{
+    temperature = 375;
+    relay = true;
+
+    // The root view shows "ntr" every other 8 seconds with the relay on.
+    CHECK (renderAt (MENU_ROOT, 0, 0) && strcmp (shown, "375") == 0);
+    CHECK ( !renderAt (MENU_ROOT, 7, 0) );
+    CHECK (renderAt (MENU_ROOT, 8, 0) && strcmp (shown, "ntr") == 0);
+    CHECK ( !renderAt (MENU_ROOT, 9, 0) );
+    relay = false;
+    CHECK (renderAt (MENU_ROOT, 9, 0) && strcmp (shown, "375") == 0);
+    temperature = 376;
+    CHECK (renderAt (MENU_ROOT, 9, 0) && strcmp (shown, "376") == 0);
+
+    // The remaining time blinks its dot every half a second.
+    CHECK (renderAt (MENU_TIMER_RUNNING, 0, 0) && strcmp (shown, "376") == 0);
+    CHECK (renderAt (MENU_TIMER_RUNNING, 8, 0) && strcmp (shown, "TTU") == 0);
+    CHECK (renderAt (MENU_TIMER_RUNNING, 8, 0x100) &&
+           strcmp (shown, "TTU.") == 0);
+    CHECK ( !renderAt (MENU_TIMER_RUNNING, 8, 0x1FF) );
+    CHECK (renderAt (MENU_TIMER_RUNNING, 8, 0x200) &&
+           strcmp (shown, "TTU") == 0);
+    paused = true;
+    CHECK (renderAt (MENU_TIMER_RUNNING, 8, 0x200) &&
+           strcmp (shown, "TTU.") == 0);
+    paused = false;
+
+    // The finished timer beeps every other half a second without drawing.
+    CHECK (renderAt (MENU_TIMER_FINISHED, 8, 0) && strcmp (shown, "End") == 0);
+    CHECK ( !beep);
+    CHECK ( !renderAt (MENU_TIMER_FINISHED, 8, 0x100) && beep);
+    CHECK (renderAt (MENU_TIMER_FINISHED, 8, 0x200) && !beep);
+
+    // The alarm and the autotune alternate with the temperature faster.
+    CHECK (renderAt (MENU_ALARM, 1, 0) && strcmp (shown, "376") == 0);
+    CHECK (renderAt (MENU_ALARM, 2, 0) && strcmp (shown, "ALr") == 0);
+    autotune = 2;
+    CHECK (renderAt (MENU_AUTOTUNE, 4, 0) && strcmp (shown, "At2") == 0);
+    autotune = 3;
+    CHECK (renderAt (MENU_AUTOTUNE, 4, 0) && strcmp (shown, "At3") == 0);
+
+    // The parameters are drawn again when the selection or value changes.
+    setParamId (3);
+    CHECK (renderAt (MENU_SELECT_PARAM, 0, 0) && strcmp (shown, "P3") == 0);
+    CHECK ( !renderAt (MENU_SELECT_PARAM, 1, 0) );
+    setParamId (11);
+    CHECK (renderAt (MENU_SELECT_PARAM, 1, 0) && strcmp (shown, "PB") == 0);
+    setParamById (11, 42);
+    CHECK (renderAt (MENU_CHANGE_PARAM, 1, 0) && strcmp (shown, "42") == 0);
+    incParam (1);
+    CHECK (renderAt (MENU_CHANGE_PARAM, 1, 0) && strcmp (shown, "43") == 0);
+    setParamById (PARAM_FERMENTATION_TIME, 8);
+    CHECK (renderAt (MENU_SET_TIMER, 1, 0) && strcmp (shown, "8") == 0);
+
+    // A state without a view shows an error.
+    CHECK (renderAt (MENU_INIT, 1, 0) && strcmp (shown, "ERR") == 0);
+    CHECK (renderAt (MENU_PROFILE, 1, 0) && strcmp (shown, "ERR") == 0);
+    draws = 0;
+    render (MENU_STATES);
+    CHECK (draws == 1 && strcmp (shown, "ERR") == 0);
+
+    return TEST_RESULT();
+}
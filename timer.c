@@ -18,6 +18,8 @@
 /**
  * Control functions for timer.
  * The TIM4 interrupt (23) is used to get signal on update event.
+ * Only the time base and the display are handled in the interrupt,
+ * the rest of periodic work is posted as tasks for the main loop.
  */
 
 #include <stdint.h>
@@ -26,39 +28,94 @@
 #include "timer.h"
 #include "stm8s003/clock.h"
 #include "stm8s003/timer.h"
-#include "adc.h"
+#include "stm8s003/interrupt.h"
+#include "buttons.h"
 #include "display.h"
-#include "params.h"
 #include "menu.h"
+#include "params.h"
+#include "persist.h"
 #include "relay.h"
-#include "buttons.h"
+#include "profile.h"
 
 #define TICKS_IN_SECOND     500
-#define BITS_FOR_TICKS      9
-#define BITS_FOR_SECONDS    6
-#define BITS_FOR_MINUTES    6
-#define BITS_FOR_HOURS      5
-#define BITS_FOR_DAYS       6
-#define SECONDS_FIRST_BIT   (BITS_FOR_TICKS + 1)
-#define MINUTES_FIRST_BIT   (BITS_FOR_TICKS + BITS_FOR_SECONDS + 1)
-#define HOURS_FIRST_BIT     (BITS_FOR_TICKS + BITS_FOR_SECONDS + BITS_FOR_MINUTES + 1)
-#define DAYS_FIRST_BIT      (BITS_FOR_TICKS + BITS_FOR_SECONDS + BITS_FOR_MINUTES + BITS_FOR_HOURS + 1)
-#define BITMASK(L)          ( ~ (0xFFFFFFFF << (L) ) )
-#define NBITMASK(L)         (0xFFFFFFFF << (L) )
+// One tick is 0.2% of a second, the trim is in 0.01% units.
+#define TRIM_PER_TICK       20
+#define SECONDS_IN_HOUR     3600L
+
+/* Fermentation timer journal */
+#define JOURNAL_PERIOD      300     // Seconds in between journal records
+#define JOURNAL_MAGIC       0xA0
+#define JOURNAL_ACTIVE      0x01
+#define JOURNAL_PAUSED      0x02
 
 /**
- * Uptime counter
- * |--Day--|--Hour--|--Minute--|--Second--|--Ticks--|
- * 31      26       21         15         9         0
+ * Uptime counter: ticks of the current second and seconds since last reset.
+ * It is decomposed into days, hours, minutes and seconds only when read.
+ * The seconds are changed by the interrupt and a 32-bit read is not atomic
+ * on the 8-bit core, so the main loop reads them with interrupts disabled.
  */
-static uint32_t uptime;
+static uint16_t uptimeTicks;
+static uint32_t uptimeSeconds;
+
 /**
- * |--Hour--|--Minute--|
- * 11       6          0
+ * Fermentation timer: seconds remaining until the end of fermentation.
+ * The interrupt counts it down, the main loop takes a copy with interrupts
+ * disabled (see readFTimer()). The active flag is a single byte, so it can
+ * be checked without that.
  */
-static uint16_t fTimer;
-static uint8_t fTimerSeconds;
+static uint32_t fTimer;
+static volatile bool fTimerActive;
+static bool fTimerPaused;
+static uint16_t journalCountdown;
+static uint16_t ticksInSecond;
+static int16_t trimPhase;
 static bool activeBeep = false;
+static volatile uint8_t tasks;
+
+/**
+ * @brief Stores state of the fermentation timer to the journal in EEPROM,
+ *  so that a run interrupted by power loss can be resumed.
+ *  The remaining time is rounded up to whole minutes.
+ */
+void storeFTimer()
+{
+    ee_journal_t rec;
+
+    INTERRUPT_DISABLE();
+    rec.minutes = (uint16_t) ( (fTimer + 59) / 60);
+    rec.flags = JOURNAL_MAGIC;
+
+    if (fTimerActive) {
+        rec.flags |= JOURNAL_ACTIVE;
+    }
+    if (fTimerPaused) {
+        rec.flags |= JOURNAL_PAUSED;
+    }
+    INTERRUPT_ENABLE();
+
+    ee_storeJournal (&rec);
+}
+
+/**
+ * @brief Resumes the fermentation timer from the journal in EEPROM
+ *  if the last run was interrupted by power loss.
+ */
+static void restoreFTimer()
+{
+    ee_journal_t rec;
+
+    fTimerActive = false;
+    fTimer = 0;
+
+    if (ee_loadJournal (&rec) && (rec.flags & 0xF0) == JOURNAL_MAGIC
+            && (rec.flags & JOURNAL_ACTIVE) && rec.minutes != 0) {
+        fTimer = rec.minutes * 60L;
+        fTimerPaused = (bool) (rec.flags & JOURNAL_PAUSED);
+        journalCountdown = JOURNAL_PERIOD;
+        fTimerActive = true;
+        enableRelay (true);
+    }
+}
 
 /**
  * @brief Initialize timer's configuration registers and reset uptime.
@@ -67,11 +124,35 @@ void initTimer()
 {
     CLK_CKDIVR = 0x00;  // Set the frequency to 16 MHz
     TIM4_PSCR = 0x07;   // CLK / 128 = 125KHz
-    TIM4_ARR = 0xF5;    // 125KHz /  250(0xFA) = 500Hz
+    TIM4_ARR = 0xF9;    // 125KHz /  250(ARR + 1) = 500Hz
     TIM4_IER = 0x01;    // Enable interrupt on update event
     TIM4_CR1 = 0x05;    // Enable timer
     resetUptime();
-    fTimer = 0;
+    ticksInSecond = TICKS_IN_SECOND;
+    trimPhase = 0;
+    restoreFTimer();
+}
+
+/**
+ * @brief Calculates the length of the next second in ticks. The clock
+ *  trim is accumulated every second, whole ticks are dropped (or added)
+ *  from the accumulated trim and the remainder is carried over to the
+ *  next second. A positive trim shortens the second.
+ */
+static void trimSecond()
+{
+    trimPhase += getParamById (PARAM_CLOCK_TRIM);
+    ticksInSecond = TICKS_IN_SECOND;
+
+    while (trimPhase >= TRIM_PER_TICK) {
+        trimPhase -= TRIM_PER_TICK;
+        ticksInSecond--;
+    }
+
+    while (trimPhase <= -TRIM_PER_TICK) {
+        trimPhase += TRIM_PER_TICK;
+        ticksInSecond++;
+    }
 }
 
 /**
@@ -79,8 +160,12 @@ void initTimer()
  */
 void startFTimer()
 {
-    fTimer = ( (getParamById (PARAM_FERMENTATION_TIME) - 1) << BITS_FOR_MINUTES) + 59;
-    fTimerSeconds = getUptimeSeconds();
+    fTimerActive = false;
+    fTimer = getParamById (PARAM_FERMENTATION_TIME) * SECONDS_IN_HOUR;
+    fTimerPaused = false;
+    journalCountdown = JOURNAL_PERIOD;
+    fTimerActive = true;
+    storeFTimer();
 }
 
 /**
@@ -88,25 +173,79 @@ void startFTimer()
  */
 void stopFTimer()
 {
+    fTimerActive = false;
     fTimer = 0;
+    storeFTimer();
+}
+
+/**
+ * @brief Suspends or resumes countdown of the fermentation timer.
+ *  The remaining time is kept while the timer is paused.
+ * @param pause
+ *  true - suspend countdown, false - resume it.
+ */
+void pauseFTimer (bool pause)
+{
+    fTimerPaused = pause;
+    storeFTimer();
+}
+
+/**
+ * @brief Checks fermentation timer to be paused.
+ * @return True if countdown of fermentation timer is suspended.
+ */
+bool isFTimerPaused()
+{
+    return fTimerPaused;
 }
 
 /**
- * @brief Gets minutes part of the fermentation timer current value.
+ * @brief Takes a copy of the fermentation timer. The interrupt may change
+ *  it in the middle of a 32-bit read, so interrupts are disabled meanwhile.
+ *  Must not be called from interrupts.
+ * @return seconds remaining until end of fermentation.
+ */
+static uint32_t readFTimer()
+{
+    uint32_t remaining;
+
+    INTERRUPT_DISABLE();
+    remaining = fTimer;
+    INTERRUPT_ENABLE();
+    return remaining;
+}
+
+/**
+ * @brief Gets seconds part of the fermentation timer value.
+ * @param remaining
+ *  copy of the fermentation timer taken by readFTimer().
+ * @return number of seconds remaining until end of that minute.
+ */
+static uint8_t getFTimerSeconds (uint32_t remaining)
+{
+    return (uint8_t) (remaining % 60);
+}
+
+/**
+ * @brief Gets minutes part of the fermentation timer value.
+ * @param remaining
+ *  copy of the fermentation timer taken by readFTimer().
  * @return number of minutes remaining until end of that hour.
  */
-uint8_t getFTimerMinutes()
+static uint8_t getFTimerMinutes (uint32_t remaining)
 {
-    return (uint8_t) (fTimer & BITMASK (BITS_FOR_MINUTES) );
+    return (uint8_t) ( (remaining / 60) % 60);
 }
 
 /**
- * @brief Gets hours part of the fermentation timer current value.
+ * @brief Gets hours part of the fermentation timer value.
+ * @param remaining
+ *  copy of the fermentation timer taken by readFTimer().
  * @return number of hours remaining.
  */
-uint8_t getFTimerHours()
+static uint8_t getFTimerHours (uint32_t remaining)
 {
-    return (uint8_t) (fTimer >> BITS_FOR_MINUTES);
+    return (uint8_t) (remaining / SECONDS_IN_HOUR);
 }
 
 /**
@@ -115,7 +254,27 @@ uint8_t getFTimerHours()
  */
 bool isFTimer()
 {
-    return fTimer != 0;
+    return fTimerActive;
+}
+
+/**
+ * @brief Gets the most significant non-zero unit of the fermentation
+ *  timer or the unit next to it.
+ * @param remaining
+ *  copy of the fermentation timer taken by readFTimer().
+ * @param lower
+ *  false - the most significant unit, true - the next lower unit.
+ * @return hours and minutes, minutes and seconds or seconds and zero.
+ */
+static uint8_t getFTimerUnit (uint32_t remaining, bool lower)
+{
+    if (remaining >= SECONDS_IN_HOUR) {
+        return lower? getFTimerMinutes (remaining): getFTimerHours (remaining);
+    } else if (remaining >= 60) {
+        return lower? getFTimerSeconds (remaining): getFTimerMinutes (remaining);
+    }
+
+    return lower? 0: getFTimerSeconds (remaining);
 }
 
 /**
@@ -123,18 +282,24 @@ bool isFTimer()
  */
 void resetUptime()
 {
-    uptime = 0;
+    uptimeTicks = 0;
+    uptimeSeconds = 0;
 }
 
 /**
- * @brief Gets raw value of bit-mapped uptime counter.
- * |--Day--|--Hour--|--Minute--|--Second--|--Ticks--|
- * 31      26       21         15         9         0
- * @return value of uptime counter.
+ * @brief Gets number of seconds being passed since last reset.
+ *  The low bits can be used for blinking without decomposition.
+ *  Must not be called from interrupts.
+ * @return value of uptime counter in seconds.
  */
 uint32_t getUptime()
 {
-    return uptime;
+    uint32_t seconds;
+
+    INTERRUPT_DISABLE();
+    seconds = uptimeSeconds;
+    INTERRUPT_ENABLE();
+    return seconds;
 }
 
 /**
@@ -143,7 +308,7 @@ uint32_t getUptime()
  */
 uint16_t getUptimeTicks()
 {
-    return (uint16_t) (uptime & BITMASK (BITS_FOR_TICKS) );
+    return uptimeTicks;
 }
 
 /**
@@ -152,7 +317,7 @@ uint16_t getUptimeTicks()
  */
 uint8_t getUptimeSeconds()
 {
-    return (uint8_t) ( (uptime >> SECONDS_FIRST_BIT) & BITMASK (BITS_FOR_SECONDS) );
+    return (uint8_t) (getUptime() % 60);
 }
 
 #ifdef CONFIG_ENABLE_FULL_UPTIME
@@ -162,7 +327,7 @@ uint8_t getUptimeSeconds()
  */
 uint8_t getUptimeMinutes()
 {
-    return (uint8_t) ( (uptime >> MINUTES_FIRST_BIT) & BITMASK (BITS_FOR_MINUTES) );
+    return (uint8_t) ( (getUptime() / 60) % 60);
 }
 
 /**
@@ -171,16 +336,16 @@ uint8_t getUptimeMinutes()
  */
 uint8_t getUptimeHours()
 {
-    return (uint8_t) ( (uptime >> HOURS_FIRST_BIT) & BITMASK (BITS_FOR_HOURS) );
+    return (uint8_t) ( (getUptime() / 3600) % 24);
 }
 
 /**
  * @brief Gets amount of days being passed since last reset.
  * @return amount of days.
  */
-uint8_t getUptimeDays()
+uint16_t getUptimeDays()
 {
-    return (uint8_t) ( (uptime >> DAYS_FIRST_BIT) & BITMASK (BITS_FOR_DAYS) );
+    return (uint16_t) (getUptime() / 86400L);
 }
 #endif
 
@@ -189,7 +354,9 @@ uint8_t getUptimeDays()
  * @param strBuff
  *  A pointer to a string buffer where the result should be placed.
  * @param format
- *  Day - d, Hour - h, Minute - m, Second -  s, Timer(hours) - T, Timer(min) - t
+ *  Day - d, Hour - h, Minute - m, Second -  s,
+ *  Timer(most significant unit) - T, Timer(next lower unit) - t,
+ *  symbol of the timer's most significant unit - U ('h', 'n' or 'S').
  *  A single letter allow numbers from 0-9, doubling the letter, from 00-99.
  *  Due to the limited display size, only the "." character is allowed
  * as a separator.
@@ -198,8 +365,11 @@ uint8_t getUptimeDays()
  */
 void uptimeToString (char *strBuff, const char *format)
 {
-    uint8_t i, j, v;
+    uint8_t i, j;
+    uint16_t v;
     char fc;
+    // All the units are taken from the same value of the timer.
+    uint32_t remaining = readFTimer();
 
     for (i = 0; (fc = format[i]) != 0; i += j) {
 
@@ -222,13 +392,19 @@ void uptimeToString (char *strBuff, const char *format)
             break;
 #endif
         case 't':
-            v = getFTimerMinutes();
+            v = getFTimerUnit (remaining, true);
             break;
 
         case 'T':
-            v = getFTimerHours();
+            v = getFTimerUnit (remaining, false);
             break;
 
+        case 'U':
+            strBuff[i] = (remaining >= SECONDS_IN_HOUR)? 'h':
+                         (remaining >= 60)? 'n': 'S';
+            j = 1;
+            continue;
+
         default:
             strBuff[i] = format[i];
             j = 1;
@@ -245,53 +421,49 @@ void uptimeToString (char *strBuff, const char *format)
     strBuff[i] = 0;
 }
 
+/**
+ * @brief Gets and clears the set of tasks posted by the timer's interrupt.
+ *  Must be called with interrupts disabled.
+ * @return bit mask of TIMER_TASK_* values.
+ */
+uint8_t takeTimerTasks()
+{
+    uint8_t t = tasks;
+
+    tasks = 0;
+    return t;
+}
+
 /**
  * @brief This function is timer's interrupt request handler
  * so keep it small and fast as much as possible.
  */
 void TIM4_UPD_handler() __interrupt (23)
 {
-    TIM4_SR &= ~TIM_SR1_UIF; // Reset flag
-
-    if ( ( (uint16_t) (uptime & BITMASK (BITS_FOR_TICKS) ) ) >= TICKS_IN_SECOND) {
-        uptime &= NBITMASK (SECONDS_FIRST_BIT);
-        uptime += (unsigned long) 1 << SECONDS_FIRST_BIT;
+    PROFILE_ENTER (PROFILE_TIM4);
 
-#ifdef CONFIG_ENABLE_FULL_UPTIME
-        // Increment minutes count when 60 seconds have passed.
-        if ( ( (uint8_t) (uptime >> SECONDS_FIRST_BIT) & BITMASK (BITS_FOR_SECONDS) ) == 60) {
-            uptime &= NBITMASK (MINUTES_FIRST_BIT);
-            uptime += (unsigned long) 1 << MINUTES_FIRST_BIT;
-        }
+    TIM4_SR &= ~TIM_SR1_UIF; // Reset flag
 
-        // Increment hours count when 60 minutes have passed.
-        if ( ( (uint8_t) (uptime >> MINUTES_FIRST_BIT) & BITMASK (BITS_FOR_MINUTES) ) == 60) {
-            uptime &= NBITMASK (HOURS_FIRST_BIT);
-            uptime += (unsigned long) 1 << HOURS_FIRST_BIT;
-        }
+    if (uptimeTicks >= ticksInSecond) {
+        uptimeTicks = 0;
+        uptimeSeconds++;
+        trimSecond();
 
-        // Increment days count when 24 hours have passed.
-        if ( ( (uint8_t) (uptime >> HOURS_FIRST_BIT) & BITMASK (BITS_FOR_HOURS) ) == 24) {
-            uptime &= NBITMASK (DAYS_FIRST_BIT);
-            uptime += (unsigned long) 1 << DAYS_FIRST_BIT;
-        }
-#endif
         // Decrement fermentation timer value.
-        if (isFTimer() && fTimerSeconds == getUptimeSeconds() ) {
-            if (getFTimerMinutes() > 0) {
-                fTimer--;
-
-                // Disable the relay functionality when the fermentation timer is exhausted.
-                if (fTimer == 0) {
-                    enableRelay (false);
-                }
-            } else {
-                fTimer = ( (getFTimerHours() - 1) << BITS_FOR_MINUTES) + 59;
+        if (fTimerActive && !fTimerPaused) {
+            // Disable the relay functionality when the fermentation timer is exhausted.
+            if (--fTimer == 0) {
+                fTimerActive = false;
+                enableRelay (false);
+                tasks |= TIMER_TASK_JOURNAL;
+            } else if (--journalCountdown == 0) {
+                journalCountdown = JOURNAL_PERIOD;
+                tasks |= TIMER_TASK_JOURNAL;
             }
         }
     }
 
-    uptime++;
+    uptimeTicks++;
 
     // Handle beep / display blink
 
@@ -301,17 +473,20 @@ void TIM4_UPD_handler() __interrupt (23)
     else
         refreshDisplay();
 
-    // Try not to call all refresh functions at once.
+    // Try not to post all refresh tasks at once. Buttons are polled here
+    // and their events are queued for the menu as the timer's event is.
 
     if ( ( (uint8_t) getUptimeTicks() & 0x0F) == 0) {
         refreshButtons();
     } else if ( ( (uint8_t) getUptimeTicks() & 0x0F) == 1) {
-        refreshMenu();
+        postMenuEvent (MENU_EVENT_CHECK_TIMER);
     } else if ( ( (uint8_t) getUptimeTicks() & 0xFF) == 2) {
-        startADC();
+        tasks |= TIMER_TASK_ADC;
     } else if ( ( (uint8_t) getUptimeTicks() & 0xFF) == 3) {
-        refreshRelay();
+        tasks |= TIMER_TASK_RELAY;
     }
+
+    PROFILE_EXIT (PROFILE_TIM4);
 }
 
 void enableBeep(uint8_t set)
@@ -16,6 +16,8 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
+#include "stm8s003/interrupt.h"
 #include "adc.h"
 #include "buttons.h"
 #include "display.h"
@@ -23,21 +25,44 @@
 #include "params.h"
 #include "relay.h"
 #include "timer.h"
+#include "profile.h"
 
-#ifndef INTERRUPT_ENABLE
-#define INTERRUPT_ENABLE()    do {__asm rim __endasm; } while(0)
-#endif
 
-#ifndef INTERRUPT_DISABLE
-#define INTERRUPT_DISABLE()   do {__asm sim __endasm; } while(0)
-#endif
+static char stringBuffer[7];
+static uint8_t viewState;
+static uint8_t viewPhase;
+static int viewValue;
 
-#ifndef WAIT_FOR_INTERRUPT
-#define WAIT_FOR_INTERRUPT()  do {__asm wfi __endasm; } while(0)
-#endif
+/**
+ * @brief Checks whether the view being shown has to be formatted again.
+ * @param phase
+ *  blink phase of the view.
+ * @param value
+ *  the value being shown.
+ * @return true if menu state, blink phase or value have changed since the
+ *  last call.
+ */
+static bool viewChanged (uint8_t phase, int value)
+{
+    uint8_t state = getMenuDisplay();
+
+    if (state == viewState && phase == viewPhase && value == viewValue) {
+        return false;
+    }
 
+    viewState = state;
+    viewPhase = phase;
+    viewValue = value;
+    return true;
+}
 
-static char stringBuffer[7];
+/**
+ * @brief Forces the view to be formatted again on the next wakeup.
+ */
+static void resetView()
+{
+    viewState = MENU_INIT;
+}
 
 static const char *showTemperature()
 {
@@ -57,24 +82,234 @@ static const char *showTemperature()
 
 static const char *showTime()
 {
-    // Making blink the dot in between the hours and minutes.
-    if ( (getUptimeTicks() & 0x100) ) {
-        uptimeToString ( stringBuffer, "Ttt");
+    // The dot blinks every half a second, it stays lit on pause.
+    bool dot = isFTimerPaused() || (getUptimeTicks() & 0x100);
+
+    // Hours and minutes as "8.30" below 10 hours, otherwise the most
+    // significant unit with its symbol: "45h", "45n" (minutes) or "45S".
+    uptimeToString ( stringBuffer, "TTU");
+
+    if (stringBuffer[0] != '0') {
+        if (dot) {
+            uptimeToString ( stringBuffer, "TTU.");
+        }
+    } else if (stringBuffer[2] == 'h') {
+        uptimeToString ( stringBuffer, dot? "T.tt": "Ttt");
     } else {
-        uptimeToString ( stringBuffer, "T.tt");
+        uptimeToString ( stringBuffer, dot? "TU.": "TU");
     }
 
     return stringBuffer;
 }
 
+static const char *showNoTimer()
+{
+    // "ntr" -> no timer is running
+    return "ntr";
+}
+
+static const char *showEnd()
+{
+    return "End";
+}
+
+static const char *showAlarm()
+{
+    return "ALr";
+}
+
+static const char *showAutotune()
+{
+    static char tuneMsg[] = {'A', 't', '0', 0};
+
+    tuneMsg[2] = '0' + getAutotuneState();
+    return tuneMsg;
+}
+
+static const char *showTimerParam()
+{
+    paramToString (PARAM_FERMENTATION_TIME, stringBuffer);
+    return stringBuffer;
+}
+
+static const char *showParamId()
+{
+    static char paramMsg[] = {'P', '0', 0};
+
+    // Parameters above P9 are shown as PA, Pb, ...
+    paramMsg[1] = (getParamId() < 10)? '0' + getParamId():
+                                       'A' + getParamId() - 10;
+    return paramMsg;
+}
+
+static const char *showParamValue()
+{
+    paramToString (getParamId(), stringBuffer);
+    return stringBuffer;
+}
+
+#ifdef CONFIG_ENABLE_PROFILER
+static int uptimeKey()
+{
+    return (uint8_t) getUptime();
+}
+
+static const char *showProfileValue()
+{
+    profileItemToString (stringBuffer, false);
+    return stringBuffer;
+}
+
+static const char *showProfileLabel()
+{
+    profileItemToString (stringBuffer, true);
+    return stringBuffer;
+}
+#endif
+
+static int constantKey()
+{
+    return 0;
+}
+
+static int timeKey()
+{
+    // The dot blinks every half a second unless paused.
+    return ( (uint8_t) getUptime() << 1) |
+           (isFTimerPaused()? 0x01: (getUptimeTicks() >> 8) & 0x01);
+}
+
+static int autotuneKey()
+{
+    return getAutotuneState();
+}
+
+static int timerParamKey()
+{
+    return getParamById (PARAM_FERMENTATION_TIME);
+}
+
+static int paramIdKey()
+{
+    return getParamId();
+}
+
+static int paramValueKey()
+{
+    return getParamById (getParamId() );
+}
+
+/**
+ * @brief Something the view can show: the text and the key which changes
+ *  whenever that text has to be formatted again.
+ */
+typedef struct {
+    int (*key) ();
+    const char * (*show) ();
+} source_t;
+
+static const source_t SRC_TEMPERATURE = {getTemperature, showTemperature};
+static const source_t SRC_NO_TIMER = {constantKey, showNoTimer};
+static const source_t SRC_TIME = {timeKey, showTime};
+static const source_t SRC_END = {constantKey, showEnd};
+static const source_t SRC_ALARM = {constantKey, showAlarm};
+static const source_t SRC_AUTOTUNE = {autotuneKey, showAutotune};
+static const source_t SRC_TIMER_PARAM = {timerParamKey, showTimerParam};
+static const source_t SRC_PARAM_ID = {paramIdKey, showParamId};
+static const source_t SRC_PARAM_VALUE = {paramValueKey, showParamValue};
+#ifdef CONFIG_ENABLE_PROFILER
+static const source_t SRC_PROFILE_VALUE = {uptimeKey, showProfileValue};
+static const source_t SRC_PROFILE_LABEL = {uptimeKey, showProfileLabel};
+#endif
+
+#define RENDER_BEEP         0x01
+#define RENDER_IF_RELAY     0x02
+
+/**
+ * @brief How the menu state is shown. The alternate source takes the place
+ *  of the primary one while (uptime & mask) is not zero.
+ */
+typedef struct {
+    const source_t *primary;
+    const source_t *alternate;
+    uint8_t mask;
+    uint8_t flags;
+} renderer_t;
+
+/* Every menu state must have its renderer. */
+static const renderer_t renderers[] = {
+    /* MENU_INIT */             {NULL, NULL, 0, 0},
+    /* MENU_ROOT */             {&SRC_TEMPERATURE, &SRC_NO_TIMER, 0x08, RENDER_IF_RELAY},
+    /* MENU_SELECT_PARAM */     {&SRC_PARAM_ID, NULL, 0, 0},
+    /* MENU_CHANGE_PARAM */     {&SRC_PARAM_VALUE, NULL, 0, 0},
+    /* MENU_SET_TIMER */        {&SRC_TIMER_PARAM, NULL, 0, 0},
+    /* MENU_TIMER_RUNNING */    {&SRC_TEMPERATURE, &SRC_TIME, 0x08, 0},
+    /* MENU_TIMER_FINISHED */   {&SRC_TEMPERATURE, &SRC_END, 0x08, RENDER_BEEP},
+    /* MENU_ALARM */            {&SRC_TEMPERATURE, &SRC_ALARM, 0x02, 0},
+    /* MENU_AUTOTUNE */         {&SRC_TEMPERATURE, &SRC_AUTOTUNE, 0x04, 0},
+#ifdef CONFIG_ENABLE_PROFILER
+    /* MENU_PROFILE */          {&SRC_PROFILE_VALUE, &SRC_PROFILE_LABEL, 0x01, 0},
+#else
+    /* MENU_PROFILE */          {NULL, NULL, 0, 0},
+#endif
+};
+
+MENU_TABLE_CHECK (renderersSize,
+                  sizeof renderers / sizeof renderers[0] == MENU_STATES);
+
+/**
+ * @brief Draws the current menu state using its renderer. The text is
+ *  formatted only when the blink phase or the shown value have changed.
+ * @param state
+ *  current menu state.
+ */
+static void render (uint8_t state)
+{
+    const renderer_t *r;
+    const source_t *src;
+    uint8_t phase;
+
+    if (state >= MENU_STATES || renderers[state].primary == NULL) {
+        setDisplayStr ("ERR");
+        setDisplayOff ( (bool) ( (uint8_t) getUptimeTicks() & 0x80) );
+        return;
+    }
+
+    r = &renderers[state];
+
+    if ( (r->flags & RENDER_BEEP) ) {
+        // Beeping every other half a second, the view is formatted again
+        // after each beep.
+        if ( (getUptimeTicks() & 0x100) ) {
+            enableBeep(true);
+            resetView();
+            return;
+        }
+        enableBeep(false);
+    }
+
+    phase = (uint8_t) getUptime() & r->mask;
+
+    if ( (r->flags & RENDER_IF_RELAY) && !isRelayEnabled() ) {
+        phase = 0;
+    }
+
+    src = phase? r->alternate: r->primary;
+
+    if ( !viewChanged (phase, src->key() ) ) {
+        return;
+    }
+
+    setDisplayStr (src->show() );
+}
+
 /**
  * @brief
  */
 int main()
 {
-    static char paramMsg[] = {'P', '0', 0};
     bool reset_once = true;
-    const char *p;
+    uint8_t tasks;
 
     initMenu();
     initButtons();
@@ -83,6 +318,9 @@ int main()
     initADC();
     initRelay();
     initTimer();
+#ifdef CONFIG_ENABLE_PROFILER
+    initProfiler();
+#endif
 
     INTERRUPT_ENABLE();
 
@@ -92,76 +330,32 @@ int main()
     // Loop
     while (true) {
 
-        switch ( getMenuDisplay() ) {
+        // Run the tasks posted by the timer's interrupt.
+        INTERRUPT_DISABLE();
+        tasks = takeTimerTasks();
+        INTERRUPT_ENABLE();
 
-        case MENU_INIT:
+        // Handle the events queued by the interrupts.
+        refreshMenu();
+
+        if (tasks & TIMER_TASK_ADC) {
+            startADC();
+        }
+        if (tasks & TIMER_TASK_RELAY) {
+            refreshRelay();
+        }
+        if (tasks & TIMER_TASK_JOURNAL) {
+            storeFTimer();
+        }
+
+        if (getMenuDisplay() == MENU_INIT) {
             if (getButton2() && getButton3() && reset_once) {
                 initParamsEEPROM(true);
                 setDisplayStr ("RST");
                 reset_once = false;
             }
-            break;
-
-        case MENU_ROOT:
-            // Alternately show values for temperature and 'no timer set'
-
-            if (isRelayEnabled() && getUptimeSeconds() & 0x08) {
-                // Show "ntr." -> no timer is running
-                p = "ntr";
-            } else {
-                p = showTemperature();
-            }
-            setDisplayStr (p);
-            break;
-
-        case MENU_TIMER_RUNNING:
-            // Alternately show values for temperature and fermentation timer
-            // if it is running.
-
-            if (getUptimeSeconds() & 0x08) {
-                p = showTime();
-            } else {
-                p = showTemperature();
-            }
-            setDisplayStr (p);
-            break;
-
-        case MENU_TIMER_FINISHED:
-            // Alternately show values for temperature and 'End'
-
-            if ( (getUptimeTicks() & 0x100) ) {
-                enableBeep(true);
-            }
-            else {
-                enableBeep(false);
-                if (getUptimeSeconds() & 0x08) {
-                    p = "End";
-                }
-                else {
-                    p = showTemperature();
-                }
-                setDisplayStr (p);
-            }
-            break;
-
-        case MENU_SET_TIMER:
-             paramToString (PARAM_FERMENTATION_TIME, stringBuffer);
-             setDisplayStr ( stringBuffer);
-             break;
-
-        case MENU_SELECT_PARAM:
-              paramMsg[1] = '0' + getParamId();
-              setDisplayStr ( paramMsg);
-              break;
-
-        case MENU_CHANGE_PARAM:
-              paramToString (getParamId(), stringBuffer);
-              setDisplayStr ( stringBuffer);
-              break;
-
-        default:
-              setDisplayStr ("ERR");
-              setDisplayOff ( (bool) ( (uint8_t) getUptimeTicks() & 0x80) );
+        } else {
+            render (getMenuDisplay() );
         }
 
         WAIT_FOR_INTERRUPT();